@@ -12,11 +12,6 @@
 #include "apex_cpu.h"
 #include "apex_macros.h"
 
-/* Nvariable to store the preveous stalling stage of CPU*/
-static int prev_stage = CONTINUE_EXEC;
-/* Variable to monitor if halt instruction was fetched while in stalled stage*/
-static int last_halt = FALSE;
-
 /* Converts the PC(4000 series) into array index for code memory
  *
  * Note: You are not supposed to edit this function
@@ -455,156 +450,223 @@ print_stage_content(const APEX_CPU *cpu)
     	{
     	case FETCH:
 			{
-		        if(cpu->debug_fetch.has_insn)
-		        {
-		            int ins_num = (cpu->debug_fetch.pc - PC_START) / INSTRUCTION_SIZE;
-		            printf("%d.  Instruction at FETCH______STAGE --->          (I%d: %02d) ", i, ins_num, cpu->debug_fetch.pc);
-		            print_instruction(&cpu->debug_fetch);
-		        }
-		        else
-		        {
-		            printf("%d.  Instruction at FETCH______STAGE --->          EMPTY", i);
-		        }
+				for(int w = 0; w < FRONTEND_WIDTH; w++)
+				{
+					if(w > 0)
+					{
+						printf("\n");
+					}
+			        if(cpu->debug_fetch[w].has_insn)
+			        {
+			            int ins_num = (cpu->debug_fetch[w].pc - PC_START) / INSTRUCTION_SIZE;
+			            printf("%d.  Instruction at FETCH______STAGE --->          (I%d: %02d) ", i, ins_num, cpu->debug_fetch[w].pc);
+			            print_instruction(&cpu->debug_fetch[w]);
+			        }
+			        else
+			        {
+			            printf("%d.  Instruction at FETCH______STAGE --->          EMPTY", i);
+			        }
+				}
 				break;
 			}
     	case DECODE_RENAME1:
 			{
-		        if(cpu->debug_decode_rename1.has_insn)
-		        {
-		            int ins_num = (cpu->debug_decode_rename1.pc - PC_START) / INSTRUCTION_SIZE;
-		            printf("%d.  Instruction at DECODE___RENAME1 --->          (I%d: %02d) ", i, ins_num, cpu->debug_decode_rename1.pc);
-		            print_instruction3(cpu, &cpu->debug_decode_rename1);
-		        }
-		        else
-		        {
-		            printf("%d.  Instruction at DECODE___RENAME1 --->          EMPTY", i);
-		        }
+				for(int w = 0; w < FRONTEND_WIDTH; w++)
+				{
+					if(w > 0)
+					{
+						printf("\n");
+					}
+			        if(cpu->debug_decode_rename1[w].has_insn)
+			        {
+			            int ins_num = (cpu->debug_decode_rename1[w].pc - PC_START) / INSTRUCTION_SIZE;
+			            printf("%d.  Instruction at DECODE___RENAME1 --->          (I%d: %02d) ", i, ins_num, cpu->debug_decode_rename1[w].pc);
+			            print_instruction3(cpu, &cpu->debug_decode_rename1[w]);
+			        }
+			        else
+			        {
+			            printf("%d.  Instruction at DECODE___RENAME1 --->          EMPTY", i);
+			        }
+				}
 				break;
 			}
     	case RENAME2_DISPATCH:
 			{
-		        if(cpu->debug_rename2_dispatch.has_insn)
-		        {
-		            int ins_num = (cpu->debug_rename2_dispatch.pc - PC_START) / INSTRUCTION_SIZE;
-		            printf("%d.  Instruction at RENAME2_DISPATCH --->          (I%d: %02d) ", i, ins_num, cpu->debug_rename2_dispatch.pc);
-		            print_instruction3(cpu, &cpu->debug_rename2_dispatch);
-		        }
-		        else
-		        {
-		            printf("%d.  Instruction at RENAME2_DISPATCH --->          EMPTY", i);
-		        }
-				break;
-			}
-    	case EXECUTE_IU:
-			{
-		        if(cpu->debug_execute_iu.has_insn)
-		        {
-		            int ins_num = (cpu->debug_execute_iu.iq_entry.pc - PC_START) / INSTRUCTION_SIZE;
-		            printf("%d.  Instruction at EXECUTE_______IU --->          (I%d: %02d) ", i, ins_num, cpu->debug_execute_iu.iq_entry.pc);
-		            print_instruction1(cpu, &cpu->debug_execute_iu);
-		        }
-		        else
-		        {
-		            printf("%d.  Instruction at EXECUTE_______IU --->          EMPTY", i);
-		        }
+				for(int w = 0; w < FRONTEND_WIDTH; w++)
+				{
+					if(w > 0)
+					{
+						printf("\n");
+					}
+			        if(cpu->debug_rename2_dispatch[w].has_insn)
+			        {
+			            int ins_num = (cpu->debug_rename2_dispatch[w].pc - PC_START) / INSTRUCTION_SIZE;
+			            printf("%d.  Instruction at RENAME2_DISPATCH --->          (I%d: %02d) ", i, ins_num, cpu->debug_rename2_dispatch[w].pc);
+			            print_instruction3(cpu, &cpu->debug_rename2_dispatch[w]);
+			        }
+			        else
+			        {
+			            printf("%d.  Instruction at RENAME2_DISPATCH --->          EMPTY", i);
+			        }
+				}
 				break;
 			}
-    	case EXECUTE_MU:
-			{
-		        if(cpu->debug_execute_mu.has_insn)
-		        {
-		            int ins_num = (cpu->debug_execute_mu.iq_entry.pc - PC_START) / INSTRUCTION_SIZE;
-		            printf("%d.  Instruction at EXECUTE_______MU --->          (I%d: %02d) ", i, ins_num, cpu->debug_execute_mu.iq_entry.pc);
-		            print_instruction1(cpu, &cpu->debug_execute_mu);
-		        }
-		        else
-		        {
-		            printf("%d.  Instruction at EXECUTE_______MU --->          EMPTY", i);
-		        }
+    	case EXECUTE_FU:
+			{
+				for(int u = 0; u < NUM_FUS; u++)
+				{
+					const FU_Unit *unit = &cpu->fu_pool[u];
+					int shown = 0;
+					if(u > 0)
+					{
+						printf("\n");
+					}
+					/* One line per instruction in flight in a pipelined unit */
+					for(int k = 0; k < unit->slots; k++)
+					{
+				        if(cpu->debug_execute_fu[u][k].has_insn)
+				        {
+				            int ins_num = (cpu->debug_execute_fu[u][k].iq_entry.pc - PC_START) / INSTRUCTION_SIZE;
+				            if(shown++ > 0)
+				            {
+				            	printf("\n");
+				            }
+				            printf("%d.  Instruction at EXECUTE_%s____%d --->          (I%d: %02d) ", i, unit->type, unit->index, ins_num, cpu->debug_execute_fu[u][k].iq_entry.pc);
+				            print_instruction1(cpu, &cpu->debug_execute_fu[u][k]);
+				        }
+					}
+			        if(!shown)
+			        {
+			            printf("%d.  Instruction at EXECUTE_%s____%d --->          EMPTY", i, unit->type, unit->index);
+			        }
+				}
 				break;
 			}
     	case EXECUTE_BU:
 			{
-		        if(cpu->debug_execute_bu.has_insn)
-		        {
-		            int ins_num = (cpu->debug_execute_bu.iq_entry.pc - PC_START) / INSTRUCTION_SIZE;
-		            printf("%d.  Instruction at EXECUTE_______BU --->          (I%d: %02d) ", i, ins_num, cpu->debug_execute_bu.iq_entry.pc);
-		            print_instruction1(cpu, &cpu->debug_execute_bu);
-		        }
-		        else
-		        {
-		            printf("%d.  Instruction at EXECUTE_______BU --->          EMPTY", i);
-		        }
+				for(int b = 0; b < NUM_BU_UNITS; b++)
+				{
+					if(b > 0)
+					{
+						printf("\n");
+					}
+			        if(cpu->debug_execute_bu[b].has_insn)
+			        {
+			            int ins_num = (cpu->debug_execute_bu[b].iq_entry.pc - PC_START) / INSTRUCTION_SIZE;
+			            printf("%d.  Instruction at EXECUTE_BU____%d --->          (I%d: %02d) ", i, b, ins_num, cpu->debug_execute_bu[b].iq_entry.pc);
+			            print_instruction1(cpu, &cpu->debug_execute_bu[b]);
+			        }
+			        else
+			        {
+			            printf("%d.  Instruction at EXECUTE_BU____%d --->          EMPTY", i, b);
+			        }
+				}
 				break;
 			}
-    	case EXECUTE_LOAD_STORE:
+    	case EXECUTE_AGU:
 			{
-		        if(cpu->debug_execute_load_store.has_insn)
-		        {
-		            int ins_num = (cpu->debug_execute_load_store.lsq_entry.pc - PC_START) / INSTRUCTION_SIZE;
-		            printf("%d.  Instruction at EXECUTE_LD_STORE --->          (I%d: %02d) ", i, ins_num, cpu->debug_execute_load_store.lsq_entry.pc);
-		            print_instruction2(cpu, &cpu->debug_execute_load_store);
-		        }
-		        else
-		        {
-		            printf("%d.  Instruction at EXECUTE_LD_STORE --->          EMPTY", i);
-		        }
+				for(int p = 0; p < NUM_AGU_PIPES; p++)
+				{
+					if(p > 0)
+					{
+						printf("\n");
+					}
+			        if(cpu->debug_execute_agu[p].has_insn)
+			        {
+			            int ins_num = (cpu->debug_execute_agu[p].iq_entry.pc - PC_START) / INSTRUCTION_SIZE;
+			            printf("%d.  Instruction at EXECUTE_AGU___%d --->          (I%d: %02d) ", i, p, ins_num, cpu->debug_execute_agu[p].iq_entry.pc);
+			            print_instruction1(cpu, &cpu->debug_execute_agu[p]);
+			        }
+			        else
+			        {
+			            printf("%d.  Instruction at EXECUTE_AGU___%d --->          EMPTY", i, p);
+			        }
+				}
 				break;
 			}
-    	case WRITEBACK_IU:
-			{
-		        if(cpu->debug_writeback_iu.has_insn)
-		        {
-		            int ins_num = (cpu->debug_writeback_iu.iq_entry.pc - PC_START) / INSTRUCTION_SIZE;
-		            printf("%d.  Instruction at WRITEBACK_____IU --->          (I%d: %02d) ", i, ins_num, cpu->debug_writeback_iu.iq_entry.pc);
-		            print_instruction1(cpu, &cpu->debug_writeback_iu);
-		        }
-		        else
-		        {
-		            printf("%d.  Instruction at WRITEBACK_____IU --->          EMPTY", i);
-		        }
+    	case EXECUTE_LOAD_STORE:
+			{
+				for(int p = 0; p < NUM_LS_PIPES; p++)
+				{
+					if(p > 0)
+					{
+						printf("\n");
+					}
+			        if(cpu->debug_execute_load_store[p].has_insn)
+			        {
+			            int ins_num = (cpu->debug_execute_load_store[p].lsq_entry.pc - PC_START) / INSTRUCTION_SIZE;
+			            printf("%d.  Instruction at EXECUTE_LDST__%d --->          (I%d: %02d) ", i, p, ins_num, cpu->debug_execute_load_store[p].lsq_entry.pc);
+			            print_instruction2(cpu, &cpu->debug_execute_load_store[p]);
+			        }
+			        else
+			        {
+			            printf("%d.  Instruction at EXECUTE_LDST__%d --->          EMPTY", i, p);
+			        }
+				}
 				break;
 			}
-    	case WRITEBACK_MU:
-			{
-		        if(cpu->debug_writeback_mu.has_insn)
-		        {
-		            int ins_num = (cpu->debug_writeback_mu.iq_entry.pc - PC_START) / INSTRUCTION_SIZE;
-		            printf("%d.  Instruction at WRITEBACK_____MU --->          (I%d: %02d) ", i, ins_num, cpu->debug_writeback_mu.iq_entry.pc);
-		            print_instruction1(cpu, &cpu->debug_writeback_mu);
-		        }
-		        else
-		        {
-		            printf("%d.  Instruction at WRITEBACK_____MU --->          EMPTY", i);
-		        }
+    	case WRITEBACK_FU:
+			{
+				for(int u = 0; u < NUM_FUS; u++)
+				{
+					const FU_Unit *unit = &cpu->fu_pool[u];
+					if(u > 0)
+					{
+						printf("\n");
+					}
+			        if(cpu->debug_writeback_fu[u].has_insn)
+			        {
+			            int ins_num = (cpu->debug_writeback_fu[u].iq_entry.pc - PC_START) / INSTRUCTION_SIZE;
+			            printf("%d.  Instruction at WRITEBACK_%s___%d --->          (I%d: %02d) ", i, unit->type, unit->index, ins_num, cpu->debug_writeback_fu[u].iq_entry.pc);
+			            print_instruction1(cpu, &cpu->debug_writeback_fu[u]);
+			        }
+			        else
+			        {
+			            printf("%d.  Instruction at WRITEBACK_%s___%d --->          EMPTY", i, unit->type, unit->index);
+			        }
+				}
 				break;
 			}
     	case WRITEBACK_BU:
 			{
-		        if(cpu->debug_writeback_bu.has_insn)
-		        {
-		            int ins_num = (cpu->debug_writeback_bu.iq_entry.pc - PC_START) / INSTRUCTION_SIZE;
-		            printf("%d. Instruction at WRITEBACK_____BU --->          (I%d: %02d) ", i, ins_num, cpu->debug_writeback_bu.iq_entry.pc);
-		            print_instruction1(cpu, &cpu->debug_writeback_bu);
-		        }
-		        else
-		        {
-		            printf("%d. Instruction at WRITEBACK_____BU --->          EMPTY", i);
-		        }
+				for(int b = 0; b < NUM_BU_UNITS; b++)
+				{
+					if(b > 0)
+					{
+						printf("\n");
+					}
+			        if(cpu->debug_writeback_bu[b].has_insn)
+			        {
+			            int ins_num = (cpu->debug_writeback_bu[b].iq_entry.pc - PC_START) / INSTRUCTION_SIZE;
+			            printf("%d. Instruction at WRITEBACK_BU__%d --->          (I%d: %02d) ", i, b, ins_num, cpu->debug_writeback_bu[b].iq_entry.pc);
+			            print_instruction1(cpu, &cpu->debug_writeback_bu[b]);
+			        }
+			        else
+			        {
+			            printf("%d. Instruction at WRITEBACK_BU__%d --->          EMPTY", i, b);
+			        }
+				}
 				break;
 			}
     	case WRITEBACK_LOAD:
 			{
-		        if(cpu->debug_writeback_load.has_insn)
-		        {
-		            int ins_num = (cpu->debug_writeback_load.lsq_entry.pc - PC_START) / INSTRUCTION_SIZE;
-		            printf("%d. Instruction at WRITEBACK___LOAD --->          (I%d: %02d) ", i, ins_num, cpu->debug_writeback_load.lsq_entry.pc);
-		            print_instruction2(cpu, &cpu->debug_writeback_load);
-		        }
-		        else
-		        {
-		            printf("%d. Instruction at WRITEBACK__LD_ST --->          EMPTY", i);
-		        }
+				for(int p = 0; p < NUM_LS_PIPES; p++)
+				{
+					if(p > 0)
+					{
+						printf("\n");
+					}
+			        if(cpu->debug_writeback_load[p].has_insn)
+			        {
+			            int ins_num = (cpu->debug_writeback_load[p].lsq_entry.pc - PC_START) / INSTRUCTION_SIZE;
+			            printf("%d. Instruction at WRITEBACK_LDST_%d --->          (I%d: %02d) ", i, p, ins_num, cpu->debug_writeback_load[p].lsq_entry.pc);
+			            print_instruction2(cpu, &cpu->debug_writeback_load[p]);
+			        }
+			        else
+			        {
+			            printf("%d. Instruction at WRITEBACK_LDST_%d --->          EMPTY", i, p);
+			        }
+				}
 				break;
 			}
     	}
@@ -781,6 +843,164 @@ print_data_memory(const APEX_CPU *cpu)
     }
 }
 
+/* Function to print the miss rate of every evaluated cache geometry,
+ * one row per set count and one column per associativity
+ *
+ */
+static void
+print_cache_sweep(const APEX_CPU *cpu)
+{
+    printf("\nCache sweep : LRU miss rates, line = %d words, accesses = %u\n", DCACHE_LINE_SIZE, cpu->cache_sweep.accesses);
+    printf(" sets \\ ways");
+    for(int w = 1; w <= SWEEP_MAX_WAYS; w *= 2)
+    {
+        printf(" %7d", w);
+    }
+    printf("\n");
+    for(int k = 0; k < SWEEP_SET_CONFIGS; k++)
+    {
+        unsigned int hits = 0;
+        printf(" %11d", 1 << k);
+        for(int w = 1, d = 0; w <= SWEEP_MAX_WAYS; w *= 2)
+        {
+            while(d < w)
+            {
+                hits += cpu->cache_sweep.hits[k][d++];
+            }
+            printf(" %6.2f%%", cpu->cache_sweep.accesses ? 100.0 * (cpu->cache_sweep.accesses - hits) / cpu->cache_sweep.accesses : 0.0);
+        }
+        printf("\n");
+    }
+}
+
+/* Function to print the redirects of every control transfer that
+ * caused one and the cycles they cost
+ *
+ */
+static void
+print_branch_penalties(const APEX_CPU *cpu)
+{
+    printf("\nBranch penalties : dispatch to redirect + %d refill cycles\n", BRANCH_REDIRECT_PENALTY);
+    printf(" %6s %10s %10s %12s\n", "pc", "redirects", "cycles", "avg penalty");
+    for(int i = 0; i < cpu->code_memory_size; i++)
+    {
+        const BRANCH_PENALTY *penalty = &cpu->bpred.penalties[i];
+
+        if(penalty->redirects)
+        {
+            printf(" %6d %10d %10u %12.2f\n", PC_START + i * INSTRUCTION_SIZE, penalty->redirects, penalty->cycles,
+                   (double)penalty->cycles / penalty->redirects);
+        }
+    }
+}
+
+/* Function which prints the front end and memory system statistics collected
+ * during the simulation
+ *
+ */
+static void
+print_simulation_stats(const APEX_CPU *cpu)
+{
+    const char *pf_name[] = {"none", "stride", "stream"};
+    const char *bp_name[] = {"bimodal", "gshare", "tournament", "tage"};
+    int useful = cpu->prefetcher.useful;
+
+    printf("\n==================== SIMULATION STATISTICS =====================\n\n");
+    printf("Front end  : width = %d fetched = %d dispatched = %d avg dispatch width = %.2f full-width cycles = %d\n",
+    		FRONTEND_WIDTH, cpu->front_end.fetched, cpu->front_end.dispatched,
+			cpu->front_end.dispatch_cycles ? (double)cpu->front_end.dispatched / cpu->front_end.dispatch_cycles : 0.0,
+			cpu->front_end.full_dispatch_cycles);
+    printf("FTQ        : entries = %d blocks = %d avg block size = %.2f avg occupancy = %.2f full cycles = %d fetch buffer = %d avg buffer occupancy = %.2f buffer full cycles = %d\n",
+    		FTQ_SIZE, cpu->front_end.blocks,
+			cpu->front_end.blocks ? (double)cpu->front_end.block_instructions / cpu->front_end.blocks : 0.0,
+			cpu->clock ? (double)cpu->front_end.ftq_occupancy / cpu->clock : 0.0, cpu->front_end.ftq_full_cycles,
+			FETCH_BUFFER_SIZE, cpu->clock ? (double)cpu->front_end.buffer_occupancy / cpu->clock : 0.0,
+			cpu->front_end.buffer_full_cycles);
+    if(TRACE_CACHE)
+    {
+        printf("Trace cache: sets = %d ways = %d lookups = %d hits = %d hit rate = %.2f%% traces built = %d instructions = %d\n",
+        		TRACE_CACHE_SETS, TRACE_CACHE_WAYS, cpu->trace_cache.lookups, cpu->trace_cache.hits,
+    			cpu->trace_cache.lookups ? 100.0 * cpu->trace_cache.hits / cpu->trace_cache.lookups : 0.0,
+    			cpu->trace_cache.built, cpu->trace_cache.instructions);
+    }
+    printf("Loop buffer: entries = %d loops = %d replayed = %d hit rate = %.2f%% exits = %d\n",
+    		LOOP_BUFFER ? LOOP_BUFFER_SIZE : 0, cpu->loop_buffer.loops, cpu->loop_buffer.replayed,
+			cpu->loop_buffer.delivered ? 100.0 * cpu->loop_buffer.replayed / cpu->loop_buffer.delivered : 0.0,
+			cpu->loop_buffer.exits);
+    printf("Commit     : width = %d retired = %d IPC = %.2f avg commit width = %.2f full-width cycles = %d\n",
+    		COMMIT_WIDTH, cpu->insn_completed, cpu->clock ? (double)cpu->insn_completed / cpu->clock : 0.0,
+			cpu->rb.commit_cycles ? (double)cpu->insn_completed / cpu->rb.commit_cycles : 0.0, cpu->rb.full_commit_cycles);
+    for(int u = 0; u < NUM_FUS; u++)
+    {
+    	const FU_Unit *unit = &cpu->fu_pool[u];
+
+    	printf("FU %s%-6d: opcodes = 0x%06x latency = %d pipelined = %d issued = %d avg latency = %.2f utilization = %.2f%% blocked cycles = %u\n",
+    			unit->type, unit->index, unit->opcodes, unit->latency, unit->pipelined, unit->issued,
+				unit->issued ? (double)unit->latency_sum / unit->issued : 0.0,
+				cpu->clock ? 100.0 * unit->busy_cycles / cpu->clock : 0.0, unit->blocked_cycles);
+    }
+    printf("Branch pred: type = %s branches = %d mispredicted = %d accuracy = %.2f%% MPKI = %.2f redirects = %d\n",
+    		bp_name[cpu->bpred.type], cpu->bpred.branches, cpu->bpred.mispredicted,
+			cpu->bpred.branches ? 100.0 * (cpu->bpred.branches - cpu->bpred.mispredicted) / cpu->bpred.branches : 0.0,
+			cpu->insn_completed ? 1000.0 * cpu->bpred.mispredicted / cpu->insn_completed : 0.0,
+			cpu->bpred.redirects);
+    printf("BTB        : sets = %d ways = %d entries used = %d lookups = %d hits = %d compulsory misses = %d capacity misses = %d conflict misses = %d decode redirects = %d\n",
+    		BTB_SETS, BTB_WAYS, cpu->btb.size, cpu->btb.lookups, cpu->btb.hits, cpu->btb.compulsory_misses,
+			cpu->btb.capacity_misses, cpu->btb.conflict_misses, cpu->btb.decode_redirects);
+    printf("RAS        : entries = %d returns = %d correct = %d accuracy = %.2f%%\n",
+    		RETURN_ADDRESS_STACK ? RAS_SIZE : 0, cpu->tpred.returns, cpu->tpred.returns_correct,
+			cpu->tpred.returns ? 100.0 * cpu->tpred.returns_correct / cpu->tpred.returns : 0.0);
+    printf("Indirect   : entries = %d jumps = %d hits = %d correct = %d accuracy = %.2f%%\n",
+    		INDIRECT_PREDICTOR ? INDIRECT_TABLE_SIZE : 0, cpu->tpred.jumps, cpu->tpred.indirect_hits,
+			cpu->tpred.jumps_correct, cpu->tpred.jumps ? 100.0 * cpu->tpred.jumps_correct / cpu->tpred.jumps : 0.0);
+    printf("LSQ        : out-of-order loads = %d speculative loads = %d ordering violations = %d forwarded loads = %d\n",
+    		cpu->lsq.ooo_loads, cpu->lsq.speculative_loads, cpu->lsq.violations, cpu->lsq.forwarded_loads);
+    printf("Store sets : loads = %d violation rate = %.2f%% predicted waits = %d false dependences = %d (%.2f%%)\n",
+    		cpu->store_set.loads, cpu->store_set.loads ? 100.0 * cpu->lsq.violations / cpu->store_set.loads : 0.0,
+			cpu->store_set.waits, cpu->store_set.false_dependences,
+			cpu->store_set.waits ? 100.0 * cpu->store_set.false_dependences / cpu->store_set.waits : 0.0);
+    printf("AGU        : pipes = %d split sta/std = %d addresses = %d store addresses ahead of data = %d\n",
+    		NUM_AGU_PIPES, STORE_SPLIT_STA_STD, cpu->lsq.agu_addresses, cpu->lsq.early_store_addresses);
+    printf("LSU pipes  : load pipes = %d store pipes = %d banks = %d multi-issue cycles = %d bank conflicts = %d\n",
+    		NUM_LOAD_PIPES, NUM_STORE_PIPES, DCACHE_BANKS, cpu->lsq.multi_issue_cycles, cpu->dcache.bank_conflicts);
+    printf("Store buf  : entries = %d stores = %d forwarded loads = %d full stalls = %d peak occupancy = %d\n",
+    		STORE_BUFFER_SIZE, cpu->store_buffer.stores, cpu->store_buffer.forwarded_loads, cpu->store_buffer.full_stalls,
+			cpu->store_buffer.peak_occupancy);
+    printf("Runahead   : enabled = %d episodes = %d cycles = %u pseudo-retired = %d poisoned = %d prefetches = %d\n",
+    		RUNAHEAD_EXECUTION, cpu->runahead.episodes, cpu->runahead.cycles, cpu->runahead.pseudo_retired,
+			cpu->runahead.poisoned, cpu->runahead.prefetches);
+    printf("Value pred : loads = %d predicted = %d coverage = %.2f%% correct = %d accuracy = %.2f%% recoveries = %d squashed = %d\n",
+    		cpu->value_predictor.loads, cpu->value_predictor.predicted,
+			cpu->value_predictor.loads ? 100.0 * cpu->value_predictor.predicted / cpu->value_predictor.loads : 0.0,
+			cpu->value_predictor.correct,
+			cpu->value_predictor.predicted ? 100.0 * cpu->value_predictor.correct / cpu->value_predictor.predicted : 0.0,
+			cpu->value_predictor.mispredicted, cpu->value_predictor.squashed);
+    printf("D-Cache    : accesses = %d hits = %d misses = %d miss rate = %.2f%%\n", cpu->dcache.accesses, cpu->dcache.hits,
+    		cpu->dcache.misses, cpu->dcache.accesses ? 100.0 * cpu->dcache.misses / cpu->dcache.accesses : 0.0);
+    printf("MSHR       : entries = %d primary misses = %d merged misses = %d full stalls = %d peak outstanding = %d avg outstanding = %.2f\n",
+    		NUM_MSHRS, cpu->mshr.primary_misses, cpu->mshr.secondary_misses, cpu->mshr.full_stalls, cpu->mshr.peak_outstanding,
+			cpu->clock ? (double)cpu->mshr.outstanding_cycles / cpu->clock : 0.0);
+    printf("Prefetcher : type = %s degree = %d issued = %d redundant = %d useful = %d late = %d useless = %d\n",
+    		pf_name[cpu->prefetcher.type], cpu->prefetcher.degree, cpu->prefetcher.issued, cpu->prefetcher.redundant,
+			useful, cpu->prefetcher.late, cpu->prefetcher.useless);
+    printf("Prefetcher : accuracy = %.2f%% coverage = %.2f%% timeliness = %.2f%%\n",
+    		cpu->prefetcher.issued ? 100.0 * useful / cpu->prefetcher.issued : 0.0,
+			(useful + cpu->dcache.misses) ? 100.0 * useful / (useful + cpu->dcache.misses) : 0.0,
+			useful ? 100.0 * (useful - cpu->prefetcher.late) / useful : 0.0);
+    if(MEM_TRACE)
+    {
+        printf("Mem trace  : file = %s records = %u\n", MEM_TRACE_FILE, cpu->mem_trace.written + cpu->mem_trace.count);
+    }
+    if(CACHE_SWEEP)
+    {
+        print_cache_sweep(cpu);
+    }
+    if(cpu->bpred.redirects)
+    {
+        print_branch_penalties(cpu);
+    }
+}
+
 /* Debug function which prints the debug messages in each
  * cycle based on the CPU command
  *
@@ -801,6 +1021,7 @@ print_debug_info(const APEX_CPU *cpu)
                     print_lsq(cpu);
                     print_rob(cpu);
                     print_data_memory(cpu);
+                    print_simulation_stats(cpu);
                     printf("\nAPEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
                     return TRUE;
                 }
@@ -817,6 +1038,7 @@ print_debug_info(const APEX_CPU *cpu)
                     print_lsq(cpu);
                     print_rob(cpu);
                     print_data_memory(cpu);
+                    print_simulation_stats(cpu);
                     printf("\nAPEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
                     return TRUE;
                 }
@@ -908,6 +1130,23 @@ allocate_physical_register(APEX_CPU *cpu, uint8 reg)
 	cpu->phys_regs[reg].wbv.BYTE = 0;
 }
 
+/* Function to release the physical register of a retired
+ * instruction back to the free pool
+ *
+ */
+static void
+free_physical_register(APEX_CPU *cpu, int reg)
+{
+	if(reg < 0 || reg >= PHYS_REG_FILE_SIZE)
+	{
+		return;
+	}
+	cpu->phys_regs[reg].al = UN_ALLOCATED;
+	cpu->phys_regs[reg].renamed = NOT_RENAMED;
+	cpu->phys_regs[reg].status = INVALID;
+	cpu->phys_regs[reg].wbv.BYTE = 0;
+}
+
 /* Function to get the free issue queue entry
  *
  */
@@ -958,19 +1197,56 @@ get_free_rob_entry(APEX_CPU *cpu)
 	return id;
 }
 
+/* Function to find the functional unit forwarding the result
+ * of a rob entry, returns NULL if no unit has it
+ *
+ */
+static DATA_FORWARDING_LATCH *
+get_fu_latch(APEX_CPU *cpu, int reg)
+{
+	for(int u = 0; u < NUM_FUS; u++)
+	{
+		for(int k = 0; k < cpu->fu_pool[u].slots; k++)
+		{
+			if(cpu->execute_fu[u][k].latch.reg_id == reg && cpu->execute_fu[u][k].latch.ready == VALID)
+			{
+				return &cpu->execute_fu[u][k].latch;
+			}
+		}
+	}
+	return NULL;
+}
+
+/* Function to find the load/store pipe forwarding the result
+ * of a rob entry, returns NULL if no pipe has it
+ *
+ */
+static DATA_FORWARDING_LATCH *
+get_load_store_latch(APEX_CPU *cpu, int reg)
+{
+	for(int p = 0; p < NUM_LS_PIPES; p++)
+	{
+		if(cpu->execute_load_store[p].latch.reg_id == reg && cpu->execute_load_store[p].latch.ready == VALID)
+		{
+			return &cpu->execute_load_store[p].latch;
+		}
+	}
+	return NULL;
+}
+
 /* Function to update the src1 of the issue queue entry
  *
  */
 static void
-update_src1(int reg, int id, APEX_CPU *cpu)
+update_src1(int reg, int id, APEX_CPU *cpu, const CPU_Stage *stage)
 {
-	cpu->iq.entries[id].src1_src = cpu->rename_table[cpu->rename2_dispatch.rs1].src_bit;
-	if(cpu->rename_table[cpu->rename2_dispatch.rs1].src_bit == 0)
+	cpu->iq.entries[id].src1_src = cpu->rename_table[stage->rs1].src_bit;
+	if(cpu->rename_table[stage->rs1].src_bit == 0)
 	{
 		cpu->iq.entries[id].src1_ready = VALID;
-		cpu->iq.entries[id].src1_value = cpu->arch_regs[cpu->rename2_dispatch.rs1].value;
-		cpu->iq.entries[id].z_flag = cpu->arch_regs[cpu->rename2_dispatch.rs1].z_flag;
-		cpu->iq.entries[id].p_flag = cpu->arch_regs[cpu->rename2_dispatch.rs1].p_flag;
+		cpu->iq.entries[id].src1_value = cpu->arch_regs[stage->rs1].value;
+		cpu->iq.entries[id].z_flag = cpu->arch_regs[stage->rs1].z_flag;
+		cpu->iq.entries[id].p_flag = cpu->arch_regs[stage->rs1].p_flag;
 	}
 	else
 	{
@@ -983,26 +1259,19 @@ update_src1(int reg, int id, APEX_CPU *cpu)
 		}
 		else
 		{
-			if(cpu->execute_iu.latch.reg_id == reg && cpu->execute_iu.latch.ready == VALID)
+			if(get_fu_latch(cpu, reg))
 			{
 				cpu->iq.entries[id].src1_ready = VALID;
-				cpu->iq.entries[id].src1_value = cpu->execute_iu.latch.data;
-				cpu->iq.entries[id].z_flag = cpu->execute_iu.latch.z_flag;
-				cpu->iq.entries[id].p_flag = cpu->execute_iu.latch.p_flag;
+				cpu->iq.entries[id].src1_value = get_fu_latch(cpu, reg)->data;
+				cpu->iq.entries[id].z_flag = get_fu_latch(cpu, reg)->z_flag;
+				cpu->iq.entries[id].p_flag = get_fu_latch(cpu, reg)->p_flag;
 			}
-			else if(cpu->execute_mu.latch.reg_id == reg && cpu->execute_mu.latch.ready == VALID)
+			else if(get_load_store_latch(cpu, reg))
 			{
 				cpu->iq.entries[id].src1_ready = VALID;
-				cpu->iq.entries[id].src1_value = cpu->execute_mu.latch.data;
-				cpu->iq.entries[id].z_flag = cpu->execute_iu.latch.z_flag;
-				cpu->iq.entries[id].p_flag = cpu->execute_iu.latch.p_flag;
-			}
-			else if(cpu->execute_load_store.latch.reg_id == reg && cpu->execute_load_store.latch.ready == VALID)
-			{
-				cpu->iq.entries[id].src1_ready = VALID;
-				cpu->iq.entries[id].src1_value = cpu->execute_load_store.latch.data;
-				cpu->iq.entries[id].z_flag = cpu->execute_iu.latch.z_flag;
-				cpu->iq.entries[id].p_flag = cpu->execute_iu.latch.p_flag;
+				cpu->iq.entries[id].src1_value = get_load_store_latch(cpu, reg)->data;
+				cpu->iq.entries[id].z_flag = get_load_store_latch(cpu, reg)->z_flag;
+				cpu->iq.entries[id].p_flag = get_load_store_latch(cpu, reg)->p_flag;
 			}
 			else
 			{
@@ -1017,13 +1286,13 @@ update_src1(int reg, int id, APEX_CPU *cpu)
  *
  */
 static void
-update_src2(int reg, int id, APEX_CPU *cpu)
+update_src2(int reg, int id, APEX_CPU *cpu, const CPU_Stage *stage)
 {
-	cpu->iq.entries[id].src2_src = cpu->rename_table[cpu->rename2_dispatch.rs2].src_bit;
-	if(cpu->rename_table[cpu->rename2_dispatch.rs2].src_bit == 0)
+	cpu->iq.entries[id].src2_src = cpu->rename_table[stage->rs2].src_bit;
+	if(cpu->rename_table[stage->rs2].src_bit == 0)
 	{
 		cpu->iq.entries[id].src2_ready = VALID;
-		cpu->iq.entries[id].src2_value = cpu->arch_regs[cpu->rename2_dispatch.rs2].value;
+		cpu->iq.entries[id].src2_value = cpu->arch_regs[stage->rs2].value;
 	}
 	else
 	{
@@ -1034,20 +1303,15 @@ update_src2(int reg, int id, APEX_CPU *cpu)
 		}
 		else
 		{
-			if(cpu->execute_iu.latch.reg_id == reg && cpu->execute_iu.latch.ready == VALID)
-			{
-				cpu->iq.entries[id].src2_ready = VALID;
-				cpu->iq.entries[id].src2_value = cpu->execute_iu.latch.data;
-			}
-			else if(cpu->execute_mu.latch.reg_id == reg && cpu->execute_mu.latch.ready == VALID)
+			if(get_fu_latch(cpu, reg))
 			{
 				cpu->iq.entries[id].src2_ready = VALID;
-				cpu->iq.entries[id].src2_value = cpu->execute_mu.latch.data;
+				cpu->iq.entries[id].src2_value = get_fu_latch(cpu, reg)->data;
 			}
-			else if(cpu->execute_load_store.latch.reg_id == reg && cpu->execute_load_store.latch.ready == VALID)
+			else if(get_load_store_latch(cpu, reg))
 			{
 				cpu->iq.entries[id].src2_ready = VALID;
-				cpu->iq.entries[id].src2_value = cpu->execute_load_store.latch.data;
+				cpu->iq.entries[id].src2_value = get_load_store_latch(cpu, reg)->data;
 			}
 			else
 			{
@@ -1062,25 +1326,25 @@ update_src2(int reg, int id, APEX_CPU *cpu)
  *
  */
 static void
-update_issue_queue_entry(int id, int lid, int rob_id, APEX_CPU *cpu)
+update_issue_queue_entry(int id, int lid, int rob_id, APEX_CPU *cpu, const CPU_Stage *stage)
 {
-	int p1 = cpu->rename2_dispatch.p1;
-	int p2 = cpu->rename2_dispatch.p2;
+	int p1 = stage->p1;
+	int p2 = stage->p2;
 	cpu->iq.entries[id].al = ALLOCATED;
 	cpu->iq.size++;
 	cpu->iq.entries[id].cycle = cpu->clock;
-	cpu->iq.entries[id].pc = cpu->rename2_dispatch.pc;
-	cpu->iq.entries[id].dest = cpu->rename2_dispatch.pd;
-	cpu->iq.entries[id].fu_type = cpu->rename2_dispatch.opcode;
-	cpu->iq.entries[id].literal = cpu->rename2_dispatch.imm;
+	cpu->iq.entries[id].pc = stage->pc;
+	cpu->iq.entries[id].dest = stage->pd;
+	cpu->iq.entries[id].fu_type = stage->opcode;
+	cpu->iq.entries[id].literal = stage->imm;
 	cpu->iq.entries[id].src1_tag = p1;
 	cpu->iq.entries[id].src2_tag = p2;
 	cpu->iq.entries[id].lsq_id = lid;
 	cpu->iq.entries[id].rob_id = rob_id;
-	cpu->iq.entries[id].btb_id = cpu->rename2_dispatch.btb_id;
-	cpu->iq.entries[id].rd = cpu->rename2_dispatch.rd;
-	memcpy(cpu->iq.entries[id].opcode_str, cpu->rename2_dispatch.opcode_str, 128);
-	switch(cpu->rename2_dispatch.opcode)
+	cpu->iq.entries[id].prediction = stage->prediction;
+	cpu->iq.entries[id].rd = stage->rd;
+	memcpy(cpu->iq.entries[id].opcode_str, stage->opcode_str, 128);
+	switch(stage->opcode)
 	{
 		case OPCODE_ADD:
 		case OPCODE_SUB:
@@ -1092,8 +1356,8 @@ update_issue_queue_entry(int id, int lid, int rob_id, APEX_CPU *cpu)
 		case OPCODE_CMP:
 		case OPCODE_STORE:
 		{
-			update_src1(p1, id, cpu);
-			update_src2(p2, id, cpu);
+			update_src1(p1, id, cpu, stage);
+			update_src2(p2, id, cpu, stage);
 			break;
 		}
 
@@ -1102,16 +1366,17 @@ update_issue_queue_entry(int id, int lid, int rob_id, APEX_CPU *cpu)
         case OPCODE_SUBL:
         case OPCODE_JUMP:
         case OPCODE_JALR:
+        case OPCODE_RET:
         case OPCODE_BP:
         case OPCODE_BNP:
         case OPCODE_BZ:
         case OPCODE_BNZ:
         {
-        	update_src1(p1, id, cpu);
+        	update_src1(p1, id, cpu, stage);
         	cpu->iq.entries[id].src2_ready = VALID;
         	cpu->iq.entries[id].src2_tag = -1;
         	cpu->iq.entries[id].src2_value = 0;
-        	if(cpu->rename2_dispatch.opcode == OPCODE_BZ)
+        	if(stage->opcode == OPCODE_BZ)
         	{
         		//printf("\nBZ before dispatch: src1_ready = %d, zflag = %d, pflag = %d\n", cpu->iq.entries[id].src1_ready, cpu->iq.entries[id].z_flag, cpu->iq.entries[id].p_flag);
         	}
@@ -1130,17 +1395,6 @@ update_issue_queue_entry(int id, int lid, int rob_id, APEX_CPU *cpu)
         	cpu->iq.entries[id].src2_value = 0;
             break;
         }
-
-        case OPCODE_RET:
-        {
-        	cpu->iq.entries[id].src1_ready = VALID;
-        	cpu->iq.entries[id].src1_tag = cpu->rename2_dispatch.p1;
-        	cpu->iq.entries[id].src1_value = cpu->rename2_dispatch.p1_value;
-        	cpu->iq.entries[id].src2_ready = VALID;
-        	cpu->iq.entries[id].src2_tag = -1;
-        	cpu->iq.entries[id].src2_value = 0;
-        	break;
-        }
 	}
 }
 
@@ -1148,30 +1402,36 @@ update_issue_queue_entry(int id, int lid, int rob_id, APEX_CPU *cpu)
  *
  */
 static void
-update_load_store_queue_entry(int lid, int rob_id, APEX_CPU *cpu)
+update_load_store_queue_entry(int lid, int rob_id, APEX_CPU *cpu, const CPU_Stage *stage)
 {
 	cpu->lsq.entries[lid].al = ALLOCATED;
 	cpu->lsq.entries[lid].cycle = cpu->clock;
-	cpu->lsq.entries[lid].pc = cpu->rename2_dispatch.pc;
-	cpu->lsq.entries[lid].dest = cpu->rename2_dispatch.pd;
-	cpu->lsq.entries[lid].src1_tag = cpu->rename2_dispatch.p1;
+	cpu->lsq.entries[lid].pc = stage->pc;
+	cpu->lsq.entries[lid].dest = stage->pd;
+	cpu->lsq.entries[lid].src1_tag = stage->p1;
 	cpu->lsq.entries[lid].data_ready = INVALID;
 	cpu->lsq.entries[lid].mem_valid = INVALID;
 	cpu->lsq.entries[lid].rob_id = rob_id;
-	cpu->lsq.entries[lid].rd = cpu->rename2_dispatch.rd;
-	memcpy(cpu->lsq.entries[lid].opcode_str, cpu->rename2_dispatch.opcode_str, 128);
-	if(cpu->rename2_dispatch.opcode == OPCODE_LOAD)
+	cpu->lsq.entries[lid].issued = FALSE;
+	cpu->lsq.entries[lid].speculative = FALSE;
+	cpu->lsq.entries[lid].forwarded = FALSE;
+	cpu->lsq.entries[lid].sb_forwarded = FALSE;
+	cpu->lsq.entries[lid].poisoned = FALSE;
+	cpu->lsq.entries[lid].value_predicted = FALSE;
+	cpu->lsq.entries[lid].rd = stage->rd;
+	memcpy(cpu->lsq.entries[lid].opcode_str, stage->opcode_str, 128);
+	if(stage->opcode == OPCODE_LOAD)
 	{
 		cpu->lsq.entries[lid].ls_bit = 0;
 	}
 	else
 	{
 		cpu->lsq.entries[lid].ls_bit = 1;
-		cpu->lsq.entries[lid].src1_src = cpu->rename_table[cpu->rename2_dispatch.rs1].src_bit;
-		if(cpu->rename_table[cpu->rename2_dispatch.rs1].src_bit == 0)
+		cpu->lsq.entries[lid].src1_src = cpu->rename_table[stage->rs1].src_bit;
+		if(cpu->rename_table[stage->rs1].src_bit == 0)
 		{
 			cpu->lsq.entries[lid].data_ready = VALID;
-			cpu->lsq.entries[lid].src1_value = cpu->arch_regs[cpu->rename2_dispatch.rs2].value;
+			cpu->lsq.entries[lid].src1_value = cpu->arch_regs[stage->rs1].value;
 		}
 		else
 		{
@@ -1182,20 +1442,15 @@ update_load_store_queue_entry(int lid, int rob_id, APEX_CPU *cpu)
 			}
 			else
 			{
-				if(cpu->execute_iu.latch.reg_id == cpu->lsq.entries[lid].src1_tag && cpu->execute_iu.latch.ready == VALID)
+				if(get_fu_latch(cpu, cpu->lsq.entries[lid].src1_tag))
 				{
 					cpu->lsq.entries[lid].data_ready = VALID;
-					cpu->lsq.entries[lid].src1_value = cpu->execute_iu.latch.data;
+					cpu->lsq.entries[lid].src1_value = get_fu_latch(cpu, cpu->lsq.entries[lid].src1_tag)->data;
 				}
-				else if(cpu->execute_mu.latch.reg_id == cpu->lsq.entries[lid].src1_tag && cpu->execute_mu.latch.ready == VALID)
+				else if(get_load_store_latch(cpu, cpu->lsq.entries[lid].src1_tag))
 				{
 					cpu->lsq.entries[lid].data_ready = VALID;
-					cpu->lsq.entries[lid].src1_value = cpu->execute_mu.latch.data;
-				}
-				else if(cpu->execute_load_store.latch.reg_id == cpu->lsq.entries[lid].src1_tag && cpu->execute_load_store.latch.ready == VALID)
-				{
-					cpu->lsq.entries[lid].data_ready = VALID;
-					cpu->lsq.entries[lid].src1_value = cpu->execute_load_store.latch.data;
+					cpu->lsq.entries[lid].src1_value = get_load_store_latch(cpu, cpu->lsq.entries[lid].src1_tag)->data;
 				}
 				else
 				{
@@ -1210,21 +1465,24 @@ update_load_store_queue_entry(int lid, int rob_id, APEX_CPU *cpu)
  *
  */
 static void
-update_rob_entry(int rob_id, APEX_CPU *cpu)
+update_rob_entry(int rob_id, APEX_CPU *cpu, const CPU_Stage *stage)
 {
 	cpu->rb.entries[rob_id].status = INVALID;
-	cpu->rb.entries[rob_id].phy_address = cpu->rename2_dispatch.pd;
-	cpu->rb.entries[rob_id].arch_address = cpu->rename2_dispatch.rd;
+	cpu->rb.entries[rob_id].phy_address = stage->pd;
+	cpu->rb.entries[rob_id].arch_address = stage->rd;
 	cpu->rb.entries[rob_id].excodes = -1;
-	cpu->rb.entries[rob_id].itype = cpu->rename2_dispatch.opcode;
-	cpu->rb.entries[rob_id].pc = cpu->rename2_dispatch.pc;
-	memcpy(cpu->rb.entries[rob_id].opcode_str, cpu->rename2_dispatch.opcode_str, 128);
+	cpu->rb.entries[rob_id].itype = stage->opcode;
+	cpu->rb.entries[rob_id].pc = stage->pc;
+	memcpy(cpu->rb.entries[rob_id].opcode_str, stage->opcode_str, 128);
 	cpu->rb.entries[rob_id].cycle = cpu->clock;
 	cpu->rb.entries[rob_id].sval_valid = INVALID;
 	cpu->rb.entries[rob_id].svalue = -1;
 	cpu->rb.entries[rob_id].result = -1;
+	cpu->rb.entries[rob_id].poisoned = FALSE;
+	cpu->rb.entries[rob_id].taken = FALSE;
+	cpu->rb.entries[rob_id].prediction = stage->prediction;
 
-	switch(cpu->rename2_dispatch.opcode)
+	switch(stage->opcode)
 	{
 		case OPCODE_ADD:
 		case OPCODE_SUB:
@@ -1237,15 +1495,12 @@ update_rob_entry(int rob_id, APEX_CPU *cpu)
         case OPCODE_ADDL:
         case OPCODE_SUBL:
 		{
-			if(cpu->rename_table[cpu->rename2_dispatch.rd].src_bit == 1)
+			if(cpu->rename_table[stage->rd].src_bit == 1)
 			{
-				cpu->phys_regs[cpu->rb.entries[cpu->rename_table[cpu->rename2_dispatch.rd].slot_id].phy_address].renamed = RENAMED;
+				cpu->phys_regs[cpu->rb.entries[cpu->rename_table[stage->rd].slot_id].phy_address].renamed = RENAMED;
 			}
-			cpu->rename_table[cpu->rename2_dispatch.rd].src_bit = 1;
-			cpu->rename_table[cpu->rename2_dispatch.rd].slot_id = rob_id;
-			cpu->arch_regs[REG_FILE_SIZE - 1].value = 0;
-			cpu->arch_regs[REG_FILE_SIZE - 1].p_flag = 0;
-			cpu->arch_regs[REG_FILE_SIZE - 1].z_flag = 0;
+			cpu->rename_table[stage->rd].src_bit = 1;
+			cpu->rename_table[stage->rd].slot_id = rob_id;
 			cpu->rename_table[REG_FILE_SIZE - 1].src_bit = 1;
 			cpu->rename_table[REG_FILE_SIZE - 1].slot_id = rob_id;
 			break;
@@ -1255,12 +1510,12 @@ update_rob_entry(int rob_id, APEX_CPU *cpu)
         case OPCODE_JALR:
         case OPCODE_MOVC:
 		{
-			if(cpu->rename_table[cpu->rename2_dispatch.rd].src_bit == 1)
+			if(cpu->rename_table[stage->rd].src_bit == 1)
 			{
-				cpu->phys_regs[cpu->rb.entries[cpu->rename_table[cpu->rename2_dispatch.rd].slot_id].phy_address].renamed = RENAMED;
+				cpu->phys_regs[cpu->rb.entries[cpu->rename_table[stage->rd].slot_id].phy_address].renamed = RENAMED;
 			}
-			cpu->rename_table[cpu->rename2_dispatch.rd].src_bit = 1;
-			cpu->rename_table[cpu->rename2_dispatch.rd].slot_id = rob_id;
+			cpu->rename_table[stage->rd].src_bit = 1;
+			cpu->rename_table[stage->rd].slot_id = rob_id;
 			break;
 		}
 
@@ -1281,1598 +1536,3882 @@ update_rob_entry(int rob_id, APEX_CPU *cpu)
 	}
 }
 
-/* Function to retire rob entries from the head
+/* Function to move an issued store from the LSQ into the
+ * store buffer, behind every older store
  *
  */
-static int rob_retirement_logic(APEX_CPU *cpu)
+static void
+store_buffer_insert(APEX_CPU *cpu, const LSQ_Entry *entry)
 {
-	if(cpu->rb.size > 0 && cpu->rb.entries[cpu->rb.front].excodes == -1)
+	SB_Entry *sb = &cpu->store_buffer.entries[(cpu->store_buffer.front + cpu->store_buffer.size) % STORE_BUFFER_SIZE];
+
+	sb->committed = FALSE;
+	sb->address = entry->mem_address;
+	sb->data = entry->src1_value;
+	sb->pc = entry->pc;
+	sb->rob_id = entry->rob_id;
+	cpu->store_buffer.size++;
+	cpu->store_buffer.stores++;
+	if(cpu->store_buffer.size > cpu->store_buffer.peak_occupancy)
 	{
-		if(cpu->rb.entries[cpu->rb.front].itype == OPCODE_HALT)
-		{
-			if(cpu->execute_iu.has_insn == 0 && cpu->execute_mu.has_insn == 0 && cpu->execute_bu.has_insn == 0 && cpu->execute_load_store.has_insn == 0 &&
-			   cpu->iq.size == 0 && cpu->lsq.size == 0)
-			{
-				cpu->rb.front = (cpu->rb.front + 1) % ROB_SIZE;
-				cpu->rb.size--;
-				return 1;
-			}
-		}
-		else if(cpu->rb.entries[cpu->rb.front].status == VALID &&
-		  (cpu->rb.entries[cpu->rb.front].itype == OPCODE_ADD  ||
-		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_SUB  ||
-		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_MUL  ||
-		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_DIV  ||
-		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_AND  ||
-		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_OR   ||
-		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_XOR  ||
-		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_MOVC ||
-		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_LOAD ||
-		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_ADDL ||
-		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_SUBL ||
-		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_CMP  ||
-		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_JALR))
-		{
-			if(cpu->phys_regs[cpu->rb.entries[cpu->rb.front].phy_address].renamed != RENAMED)
-			{
-				cpu->arch_regs[cpu->rb.entries[cpu->rb.front].arch_address].value = cpu->phys_regs[cpu->rb.entries[cpu->rb.front].phy_address].value;
-				cpu->arch_regs[cpu->rb.entries[cpu->rb.front].arch_address].z_flag = cpu->phys_regs[cpu->rb.entries[cpu->rb.front].phy_address].z_flag;
-				cpu->arch_regs[cpu->rb.entries[cpu->rb.front].arch_address].p_flag = cpu->phys_regs[cpu->rb.entries[cpu->rb.front].phy_address].p_flag;
-				cpu->rename_table[cpu->rb.entries[cpu->rb.front].arch_address].src_bit = 0;
-				cpu->rename_table[cpu->rb.entries[cpu->rb.front].arch_address].slot_id = cpu->rb.entries[cpu->rb.front].arch_address;
+		cpu->store_buffer.peak_occupancy = cpu->store_buffer.size;
+	}
+}
 
-				if(cpu->rb.entries[cpu->rb.front].itype == OPCODE_ADD  ||
-				   cpu->rb.entries[cpu->rb.front].itype == OPCODE_SUB  ||
-				   cpu->rb.entries[cpu->rb.front].itype == OPCODE_MUL  ||
-				   cpu->rb.entries[cpu->rb.front].itype == OPCODE_DIV  ||
-				   cpu->rb.entries[cpu->rb.front].itype == OPCODE_AND  ||
-				   cpu->rb.entries[cpu->rb.front].itype == OPCODE_OR   ||
-				   cpu->rb.entries[cpu->rb.front].itype == OPCODE_XOR  ||
-				   cpu->rb.entries[cpu->rb.front].itype == OPCODE_ADDL ||
-				   cpu->rb.entries[cpu->rb.front].itype == OPCODE_SUBL)
-				{
-					cpu->arch_regs[REG_FILE_SIZE - 1] = cpu->arch_regs[cpu->rb.entries[cpu->rb.front].arch_address];
-					cpu->rename_table[REG_FILE_SIZE - 1].src_bit = 0;
-					cpu->rename_table[REG_FILE_SIZE - 1].slot_id = REG_FILE_SIZE - 1;
-				}
-			}
-			cpu->rb.front = (cpu->rb.front + 1) % ROB_SIZE;
-			cpu->rb.size--;
-		}
-		else if(cpu->rb.entries[cpu->rb.front].status == VALID)
+/* Function to look for the youngest store to an address in the
+ * store buffer, every entry is older than the loads in the LSQ
+ *
+ */
+static int
+store_buffer_forward(APEX_CPU *cpu, int address, int *data)
+{
+	for(int k = cpu->store_buffer.size - 1; k >= 0; k--)
+	{
+		SB_Entry *sb = &cpu->store_buffer.entries[(cpu->store_buffer.front + k) % STORE_BUFFER_SIZE];
+		if(sb->address == address)
 		{
-			cpu->rb.front = (cpu->rb.front + 1) % ROB_SIZE;
-			cpu->rb.size--;
+			*data = sb->data;
+			return TRUE;
 		}
 	}
-	return 0;
+	return FALSE;
 }
 
-/* Function to flush the instruction during misprediction or
- * first time resolution of the branch
+/* Function to mark the store retiring from the rob as committed,
+ * it is then free to write memory
  *
  */
-static void flush_instructions_after_branch(APEX_CPU *cpu, int clock, int target)
+static void
+store_buffer_commit(APEX_CPU *cpu, int rob_id)
 {
-	cpu->pc = target;
-	cpu->decode_rename1.has_insn = FALSE;
-	switch(cpu->rename2_dispatch.opcode)
+	for(int k = 0; k < cpu->store_buffer.size; k++)
 	{
-		case OPCODE_ADD:
-		case OPCODE_SUB:
-		case OPCODE_MUL:
-		case OPCODE_DIV:
-		case OPCODE_AND:
-		case OPCODE_OR:
-		case OPCODE_XOR:
-		case OPCODE_CMP:
-	    case OPCODE_ADDL:
-	    case OPCODE_SUBL:
-	    case OPCODE_LOAD:
-	    case OPCODE_MOVC:
-		{
-			cpu->phys_regs[cpu->rename2_dispatch.pd].al = UN_ALLOCATED;
-			cpu->phys_regs[cpu->rename2_dispatch.pd].renamed = NOT_RENAMED;
-			cpu->phys_regs[cpu->rename2_dispatch.pd].status = INVALID;
-			cpu->phys_regs[cpu->rename2_dispatch.pd].value = 0;
-			cpu->phys_regs[cpu->rename2_dispatch.pd].p_flag = 0;
-			cpu->phys_regs[cpu->rename2_dispatch.pd].z_flag = 0;
-			cpu->phys_regs[cpu->rename2_dispatch.pd].wbv.BYTE = 0;
-			break;
-		}
-
-		case OPCODE_JALR:
+		SB_Entry *sb = &cpu->store_buffer.entries[(cpu->store_buffer.front + k) % STORE_BUFFER_SIZE];
+		if(!sb->committed && sb->rob_id == rob_id)
 		{
-			cpu->phys_regs[cpu->rename2_dispatch.pd].al = UN_ALLOCATED;
-			cpu->phys_regs[cpu->rename2_dispatch.pd].renamed = NOT_RENAMED;
-			cpu->phys_regs[cpu->rename2_dispatch.pd].status = INVALID;
-			cpu->phys_regs[cpu->rename2_dispatch.pd].value = 0;
-			cpu->phys_regs[cpu->rename2_dispatch.pd].p_flag = 0;
-			cpu->phys_regs[cpu->rename2_dispatch.pd].z_flag = 0;
-			cpu->phys_regs[cpu->rename2_dispatch.pd].wbv.BYTE = 0;
-			cpu->btb.entries[cpu->rename2_dispatch.btb_id].al = UN_ALLOCATED;
+			sb->committed = TRUE;
 			break;
 		}
+	}
+}
 
-		case OPCODE_BZ:
-		case OPCODE_BNZ:
-		case OPCODE_BP:
-		case OPCODE_BNP:
-		case OPCODE_JUMP:
+/* Function to drop the uncommitted stores of the squashed rob
+ * entries, every one when squashed is NULL. They are the youngest so
+ * they sit at the tail
+ *
+ */
+static void
+store_buffer_squash(APEX_CPU *cpu, const unsigned char *squashed)
+{
+	while(cpu->store_buffer.size > 0)
+	{
+		SB_Entry *sb = &cpu->store_buffer.entries[(cpu->store_buffer.front + cpu->store_buffer.size - 1) % STORE_BUFFER_SIZE];
+		if(sb->committed || (squashed && !squashed[sb->rob_id]))
 		{
-			cpu->btb.entries[cpu->rename2_dispatch.btb_id].al = UN_ALLOCATED;
 			break;
 		}
+		cpu->store_buffer.size--;
+	}
+}
 
-		case OPCODE_RET:
+/* Function to check if an instruction type allocates a physical
+ * register for its destination in decode/rename1
+ *
+ */
+static int
+check_register_writer(int opcode)
+{
+	return opcode == OPCODE_ADD || opcode == OPCODE_SUB || opcode == OPCODE_MUL || opcode == OPCODE_DIV ||
+		   opcode == OPCODE_AND || opcode == OPCODE_OR || opcode == OPCODE_XOR || opcode == OPCODE_ADDL ||
+		   opcode == OPCODE_SUBL || opcode == OPCODE_LOAD || opcode == OPCODE_MOVC || opcode == OPCODE_JALR;
+}
+
+/* Function to drop the slots of a front end group from first on,
+ * destinations already renamed go back to the free list
+ *
+ */
+static void
+squash_front_end_group(APEX_CPU *cpu, CPU_Stage *group, int first)
+{
+	for(int i = first; i < FRONTEND_WIDTH; i++)
+	{
+		if(group[i].has_insn && group[i].renamed && check_register_writer(group[i].opcode))
 		{
-			// Do nothing
-			break;
+			free_physical_register(cpu, group[i].pd);
 		}
+		group[i].has_insn = FALSE;
+		group[i].renamed = FALSE;
 	}
-	cpu->rename2_dispatch.has_insn = FALSE;
+}
+
+/* Function to drop the predicted fetch blocks and the fetched
+ * instructions that have not reached decode
+ *
+ */
+static void
+squash_fetch_queues(APEX_CPU *cpu)
+{
+	cpu->ftq.size = 0;
+	cpu->fetch_buffer.size = 0;
+	squash_front_end_group(cpu, cpu->fetch, 0);
+}
+
+/* Function to flush every instruction in flight and restart
+ * fetch at target from the committed architectural state
+ *
+ */
+static void
+flush_all_instructions(APEX_CPU *cpu, int target)
+{
+	cpu->pc = target;
+	cpu->fetch_halted = FALSE;
+	cpu->bpred.history = cpu->bpred.retired_history;
+	cpu->tpred.ras = cpu->tpred.retired_ras;
+	squash_fetch_queues(cpu);
+	cpu->loop_buffer.state = LOOP_IDLE;
+	squash_front_end_group(cpu, cpu->decode_rename1, 0);
+	squash_front_end_group(cpu, cpu->rename2_dispatch, 0);
 	cpu->stall = 0;
 	cpu->d_stall = 0;
-	prev_stage = 0;
+
+	for(int u = 0; u < NUM_FUS; u++)
+	{
+		for(int k = 0; k < FU_MAX_IN_FLIGHT; k++)
+		{
+			cpu->execute_fu[u][k].has_insn = 0;
+		}
+		cpu->writeback_fu[u].has_insn = 0;
+	}
+	for(int b = 0; b < NUM_BU_UNITS; b++)
+	{
+		cpu->execute_bu[b].has_insn = 0;
+		cpu->writeback_bu[b].has_insn = 0;
+	}
+	for(int p = 0; p < NUM_AGU_PIPES; p++)
+	{
+		cpu->execute_agu[p].has_insn = 0;
+	}
+	for(int p = 0; p < NUM_LS_PIPES; p++)
+	{
+		cpu->execute_load_store[p].has_insn = 0;
+		cpu->writeback_load[p].has_insn = 0;
+	}
 
 	for(int i = 0; i < IQ_SIZE; i++)
 	{
-		if(cpu->iq.entries[i].al == ALLOCATED && cpu->iq.entries[i].cycle <= cpu->clock && cpu->iq.entries[i].cycle > clock)
-		{
-			switch(cpu->iq.entries[i].fu_type)
-			{
-				case OPCODE_ADD:
-				case OPCODE_SUB:
-				case OPCODE_MUL:
-				case OPCODE_DIV:
-				case OPCODE_AND:
-				case OPCODE_OR:
-				case OPCODE_XOR:
-				case OPCODE_CMP:
-			    case OPCODE_ADDL:
-			    case OPCODE_SUBL:
-			    case OPCODE_MOVC:
-				{
-					cpu->phys_regs[cpu->iq.entries[i].dest].al = UN_ALLOCATED;
-					cpu->phys_regs[cpu->iq.entries[i].dest].renamed = NOT_RENAMED;
-					cpu->phys_regs[cpu->iq.entries[i].dest].status = INVALID;
-					cpu->phys_regs[cpu->iq.entries[i].dest].value = 0;
-					cpu->phys_regs[cpu->iq.entries[i].dest].p_flag = 0;
-					cpu->phys_regs[cpu->iq.entries[i].dest].z_flag = 0;
-					cpu->phys_regs[cpu->iq.entries[i].dest].wbv.BYTE = 0;
-					cpu->rename_table[cpu->iq.entries[i].rd].src_bit = cpu->backup_rename_table[cpu->iq.entries[i].rd].src_bit;
-					cpu->rename_table[cpu->iq.entries[i].rd].slot_id = cpu->backup_rename_table[cpu->iq.entries[i].rd].slot_id;
-					if(cpu->backup_rename_table[cpu->iq.entries[i].rd].src_bit == 1)
-					{
-						cpu->phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->iq.entries[i].rd].slot_id].phy_address] = cpu->backup_phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->iq.entries[i].rd].slot_id].phy_address];
-					}
-					else
-					{
-						cpu->arch_regs[cpu->backup_rename_table[cpu->iq.entries[i].rd].slot_id] = cpu->backup_arch_regs[cpu->backup_rename_table[cpu->iq.entries[i].rd].slot_id];
-					}
-
-					break;
-				}
-
-				case OPCODE_JALR:
-				{
-					cpu->phys_regs[cpu->iq.entries[i].dest].al = UN_ALLOCATED;
-					cpu->phys_regs[cpu->iq.entries[i].dest].renamed = NOT_RENAMED;
-					cpu->phys_regs[cpu->iq.entries[i].dest].status = INVALID;
-					cpu->phys_regs[cpu->iq.entries[i].dest].value = 0;
-					cpu->phys_regs[cpu->iq.entries[i].dest].p_flag = 0;
-					cpu->phys_regs[cpu->iq.entries[i].dest].z_flag = 0;
-					cpu->phys_regs[cpu->iq.entries[i].dest].wbv.BYTE = 0;
-
-					cpu->rename_table[cpu->iq.entries[i].rd].src_bit = cpu->backup_rename_table[cpu->iq.entries[i].rd].src_bit;
-					cpu->rename_table[cpu->iq.entries[i].rd].slot_id = cpu->backup_rename_table[cpu->iq.entries[i].rd].slot_id;
-					if(cpu->backup_rename_table[cpu->iq.entries[i].rd].src_bit == 1)
-					{
-						cpu->phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->iq.entries[i].rd].slot_id].phy_address] = cpu->backup_phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->iq.entries[i].rd].slot_id].phy_address];
-					}
-					else
-					{
-						cpu->arch_regs[cpu->backup_rename_table[cpu->iq.entries[i].rd].slot_id] = cpu->backup_arch_regs[cpu->backup_rename_table[cpu->iq.entries[i].rd].slot_id];
-					}
-					cpu->btb.entries[cpu->iq.entries[i].btb_id].al = UN_ALLOCATED;
-					break;
-				}
-
-				case OPCODE_BZ:
-				case OPCODE_BNZ:
-				case OPCODE_BP:
-				case OPCODE_BNP:
-				case OPCODE_JUMP:
-				{
-					cpu->btb.entries[cpu->iq.entries[i].btb_id].al = UN_ALLOCATED;
-					break;
-				}
-
-				case OPCODE_RET:
-				{
-					// Do nothing
-					break;
-				}
-			}
-			cpu->iq.entries[i].al = UN_ALLOCATED;
-			cpu->iq.size--;
-		}
+		cpu->iq.entries[i].al = UN_ALLOCATED;
 	}
-
+	cpu->iq.size = 0;
 	for(int i = 0; i < LSQ_SIZE; i++)
 	{
-		if(cpu->lsq.entries[i].al == ALLOCATED && cpu->lsq.entries[i].cycle <= cpu->clock && cpu->lsq.entries[i].cycle > clock)
-		{
-			cpu->lsq.entries[i].al = UN_ALLOCATED;
-			cpu->lsq.size--;
-		}
+		cpu->lsq.entries[i].al = UN_ALLOCATED;
 	}
-
-	if(cpu->lsq.size > 0)
+	cpu->lsq.front = 0;
+	cpu->lsq.rear = -1;
+	cpu->lsq.size = 0;
+	cpu->rb.front = 0;
+	cpu->rb.rear = -1;
+	cpu->rb.size = 0;
+
+	for(int i = 0; i < LFST_SIZE; i++)
 	{
-		if(cpu->lsq.rear >= cpu->lsq.front)
-		{
-	    	while(cpu->lsq.size > 0 && (cpu->lsq.entries[cpu->lsq.rear].cycle > clock && cpu->lsq.entries[cpu->lsq.rear].cycle <= cpu->clock))
-	    	{
-	    		cpu->lsq.entries[cpu->lsq.rear].al = UN_ALLOCATED;
-	    		if(cpu->lsq.entries[cpu->lsq.rear].ls_bit == 0)
-	    		{
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].al = UN_ALLOCATED;
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].renamed = NOT_RENAMED;
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].status = INVALID;
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].value = 0;
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].p_flag = 0;
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].z_flag = 0;
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].wbv.BYTE = 0;
-
-					cpu->rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].src_bit = cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].src_bit;
-					cpu->rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].slot_id = cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].slot_id;
-					if(cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].src_bit == 1)
-					{
-						cpu->phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].slot_id].phy_address] =
-								cpu->backup_phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].slot_id].phy_address];
-					}
-					else
-					{
-						cpu->arch_regs[cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].slot_id] = cpu->backup_arch_regs[cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].slot_id];
-					}
-	    		}
-	    		cpu->lsq.rear--;
-	    		cpu->lsq.size--;
-	    	}
-		}
-		else
-		{
-	    	while(cpu->lsq.size > 0 && (cpu->lsq.entries[cpu->lsq.rear].cycle > clock && cpu->lsq.entries[cpu->lsq.rear].cycle <= cpu->clock))
-	    	{
-	    		cpu->lsq.entries[cpu->lsq.rear].al = UN_ALLOCATED;
-	    		if(cpu->lsq.entries[cpu->lsq.rear].ls_bit == 0)
-	    		{
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].al = UN_ALLOCATED;
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].renamed = NOT_RENAMED;
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].status = INVALID;
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].value = 0;
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].p_flag = 0;
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].z_flag = 0;
-					cpu->phys_regs[cpu->lsq.entries[cpu->lsq.rear].dest].wbv.BYTE = 0;
-
-					cpu->rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].src_bit = cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].src_bit;
-					cpu->rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].slot_id = cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].slot_id;
-					if(cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].src_bit == 1)
-					{
-						cpu->phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].slot_id].phy_address] =
-								cpu->backup_phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].slot_id].phy_address];
-					}
-					else
-					{
-						cpu->arch_regs[cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].slot_id] = cpu->backup_arch_regs[cpu->backup_rename_table[cpu->lsq.entries[cpu->lsq.rear].rd].slot_id];
-					}
-	    		}
-	    		if(cpu->lsq.rear > 0)
-	    		{
-		    		cpu->lsq.rear--;
-		    		cpu->lsq.size--;
-	    		}
-	    		else
-	    		{
-	    			cpu->lsq.rear = LSQ_SIZE - 1;
-		    		cpu->lsq.size--;
-	    		}
-	    	}
-		}
-	}
-
-
-	if(cpu->rb.size > 0)
-	{
-	    if(cpu->rb.rear >= cpu->rb.front)
-	    {
-	    	while(cpu->rb.size > 0 && (cpu->rb.entries[cpu->rb.rear].cycle > clock && cpu->rb.entries[cpu->rb.rear].cycle <= cpu->clock))
-	    	{
-	    		printf("ROB entry deleted from rear = %d\n", cpu->rb.rear);
-	    		cpu->rb.rear--;
-	    		cpu->rb.size--;
-	    	}
-	    }
-	    else
-	    {
-	    	while(cpu->rb.size > 0 && (cpu->rb.entries[cpu->rb.rear].cycle > clock && cpu->rb.entries[cpu->rb.rear].cycle <= cpu->clock))
-	    	{
-	    		if(cpu->rb.rear > 0)
-	    		{
-	    			printf("ROB entry deleted from rear = %d\n", cpu->rb.rear);
-		    		cpu->rb.rear--;
-		    		cpu->rb.size--;
-	    		}
-	    		else
-	    		{
-	    			printf("ROB entry deleted from rear = %d\n", cpu->rb.rear);
-	    			cpu->rb.rear = ROB_SIZE - 1;
-		    		cpu->rb.size--;
-	    		}
-	    	}
-	    }
-	}
-
-	if(cpu->execute_iu.has_insn == 1 && cpu->execute_iu.iq_entry.cycle > clock && cpu->execute_iu.iq_entry.cycle <= cpu->clock)
-	{
-		if(cpu->execute_iu.iq_entry.fu_type == OPCODE_ADD   ||
-		   cpu->execute_iu.iq_entry.fu_type == OPCODE_SUB   ||
-		   cpu->execute_iu.iq_entry.fu_type == OPCODE_AND   ||
-		   cpu->execute_iu.iq_entry.fu_type == OPCODE_OR    ||
-		   cpu->execute_iu.iq_entry.fu_type == OPCODE_XOR   ||
-		   cpu->execute_iu.iq_entry.fu_type == OPCODE_CMP   ||
-		   cpu->execute_iu.iq_entry.fu_type == OPCODE_ADDL  ||
-		   cpu->execute_iu.iq_entry.fu_type == OPCODE_SUBL  ||
-		   cpu->execute_iu.iq_entry.fu_type == OPCODE_MOVC)
-		   {
-				cpu->phys_regs[cpu->execute_iu.iq_entry.dest].al = UN_ALLOCATED;
-				cpu->phys_regs[cpu->execute_iu.iq_entry.dest].renamed = NOT_RENAMED;
-				cpu->phys_regs[cpu->execute_iu.iq_entry.dest].status = INVALID;
-				cpu->phys_regs[cpu->execute_iu.iq_entry.dest].value = 0;
-				cpu->phys_regs[cpu->execute_iu.iq_entry.dest].p_flag = 0;
-				cpu->phys_regs[cpu->execute_iu.iq_entry.dest].z_flag = 0;
-				cpu->phys_regs[cpu->execute_iu.iq_entry.dest].wbv.BYTE = 0;
-
-				cpu->rename_table[cpu->execute_iu.iq_entry.rd].src_bit = cpu->backup_rename_table[cpu->execute_iu.iq_entry.rd].src_bit;
-				cpu->rename_table[cpu->execute_iu.iq_entry.rd].slot_id = cpu->backup_rename_table[cpu->execute_iu.iq_entry.rd].slot_id;
-				if(cpu->backup_rename_table[cpu->execute_iu.iq_entry.rd].src_bit == 1)
-				{
-					cpu->phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->execute_iu.iq_entry.rd].slot_id].phy_address] =
-							cpu->backup_phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->execute_iu.iq_entry.rd].slot_id].phy_address];
-				}
-				else
-				{
-					cpu->arch_regs[cpu->backup_rename_table[cpu->execute_iu.iq_entry.rd].slot_id] = cpu->backup_arch_regs[cpu->backup_rename_table[cpu->execute_iu.iq_entry.rd].slot_id];
-				}
-		   }
-		   cpu->execute_iu.has_insn = 0;
-	}
-
-	if(cpu->writeback_iu.has_insn == 1 && cpu->writeback_iu.iq_entry.cycle > clock && cpu->writeback_iu.iq_entry.cycle <= cpu->clock)
-	{
-		if(cpu->writeback_iu.iq_entry.fu_type == OPCODE_ADD   ||
-		   cpu->writeback_iu.iq_entry.fu_type == OPCODE_SUB   ||
-		   cpu->writeback_iu.iq_entry.fu_type == OPCODE_AND   ||
-		   cpu->writeback_iu.iq_entry.fu_type == OPCODE_OR    ||
-		   cpu->writeback_iu.iq_entry.fu_type == OPCODE_XOR   ||
-		   cpu->writeback_iu.iq_entry.fu_type == OPCODE_CMP   ||
-		   cpu->writeback_iu.iq_entry.fu_type == OPCODE_ADDL  ||
-		   cpu->writeback_iu.iq_entry.fu_type == OPCODE_SUBL  ||
-		   cpu->writeback_iu.iq_entry.fu_type == OPCODE_MOVC)
-		   {
-				cpu->phys_regs[cpu->writeback_iu.iq_entry.dest].al = UN_ALLOCATED;
-				cpu->phys_regs[cpu->writeback_iu.iq_entry.dest].renamed = NOT_RENAMED;
-				cpu->phys_regs[cpu->writeback_iu.iq_entry.dest].status = INVALID;
-				cpu->phys_regs[cpu->writeback_iu.iq_entry.dest].value = 0;
-				cpu->phys_regs[cpu->writeback_iu.iq_entry.dest].p_flag = 0;
-				cpu->phys_regs[cpu->writeback_iu.iq_entry.dest].z_flag = 0;
-				cpu->phys_regs[cpu->writeback_iu.iq_entry.dest].wbv.BYTE = 0;
-
-				cpu->rename_table[cpu->writeback_iu.iq_entry.rd].src_bit = cpu->backup_rename_table[cpu->writeback_iu.iq_entry.rd].src_bit;
-				cpu->rename_table[cpu->writeback_iu.iq_entry.rd].slot_id = cpu->backup_rename_table[cpu->writeback_iu.iq_entry.rd].slot_id;
-				if(cpu->backup_rename_table[cpu->writeback_iu.iq_entry.rd].src_bit == 1)
-				{
-					cpu->phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->writeback_iu.iq_entry.rd].slot_id].phy_address] =
-							cpu->backup_phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->writeback_iu.iq_entry.rd].slot_id].phy_address];
-				}
-				else
-				{
-					cpu->arch_regs[cpu->backup_rename_table[cpu->writeback_iu.iq_entry.rd].slot_id] = cpu->backup_arch_regs[cpu->backup_rename_table[cpu->writeback_iu.iq_entry.rd].slot_id];
-				}
-		   }
-		   cpu->writeback_iu.has_insn = 0;
+		cpu->store_set.lfst[i].valid = FALSE;
 	}
 
-	if(cpu->execute_mu.has_insn == 1 && cpu->execute_mu.iq_entry.cycle > clock && cpu->execute_mu.iq_entry.cycle <= cpu->clock)
+	/* Retired stores still go to memory */
+	store_buffer_squash(cpu, NULL);
+
+	/* Lines in flight still fill the cache, nobody waits on them */
+	for(int i = 0; i < NUM_MSHRS; i++)
 	{
-		cpu->phys_regs[cpu->execute_mu.iq_entry.dest].al = UN_ALLOCATED;
-		cpu->phys_regs[cpu->execute_mu.iq_entry.dest].renamed = NOT_RENAMED;
-		cpu->phys_regs[cpu->execute_mu.iq_entry.dest].status = INVALID;
-		cpu->phys_regs[cpu->execute_mu.iq_entry.dest].value = 0;
-		cpu->phys_regs[cpu->execute_mu.iq_entry.dest].p_flag = 0;
-		cpu->phys_regs[cpu->execute_mu.iq_entry.dest].z_flag = 0;
-		cpu->phys_regs[cpu->execute_mu.iq_entry.dest].wbv.BYTE = 0;
+		cpu->mshr.entries[i].valid = FALSE;
+		cpu->mshr.entries[i].num_targets = 0;
+	}
 
-		cpu->rename_table[cpu->execute_mu.iq_entry.rd].src_bit = cpu->backup_rename_table[cpu->execute_mu.iq_entry.rd].src_bit;
-		cpu->rename_table[cpu->execute_mu.iq_entry.rd].slot_id = cpu->backup_rename_table[cpu->execute_mu.iq_entry.rd].slot_id;
-		if(cpu->backup_rename_table[cpu->execute_mu.iq_entry.rd].src_bit == 1)
-		{
-			cpu->phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->execute_mu.iq_entry.rd].slot_id].phy_address] = cpu->backup_phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->execute_mu.iq_entry.rd].slot_id].phy_address];
-		}
-		else
-		{
-			cpu->arch_regs[cpu->backup_rename_table[cpu->execute_mu.iq_entry.rd].slot_id] = cpu->backup_arch_regs[cpu->backup_rename_table[cpu->execute_mu.iq_entry.rd].slot_id];
-		}
-		cpu->execute_mu.has_insn = 0;
+	memset(cpu->phys_regs, 0, sizeof(PHYS_REG) * PHYS_REG_FILE_SIZE);
+	for(int i = 0; i < REG_FILE_SIZE; i++)
+	{
+		cpu->rename_table[i].slot_id = i;
+		cpu->rename_table[i].src_bit = 0;
 	}
+}
 
-	if(cpu->writeback_mu.has_insn == 1 && cpu->writeback_mu.iq_entry.cycle > clock && cpu->writeback_mu.iq_entry.cycle <= cpu->clock)
+/* Function to check if an instruction type renames the flags
+ *
+ */
+static int
+check_flag_setter(int itype)
+{
+	return itype == OPCODE_ADD || itype == OPCODE_SUB || itype == OPCODE_MUL || itype == OPCODE_DIV ||
+		   itype == OPCODE_AND || itype == OPCODE_OR || itype == OPCODE_XOR || itype == OPCODE_CMP ||
+		   itype == OPCODE_ADDL || itype == OPCODE_SUBL;
+}
+
+/* Function to check if an instruction is a conditional branch,
+ * the only ones shifted into the global history
+ *
+ */
+static int
+check_conditional_branch(int itype)
+{
+	return itype == OPCODE_BZ || itype == OPCODE_BNZ || itype == OPCODE_BP || itype == OPCODE_BNP;
+}
+
+/* Function to check if an instruction transfers control, the ones
+ * predicted at fetch and resolved in the branch unit
+ *
+ */
+static int
+check_control_transfer(int itype)
+{
+	return check_conditional_branch(itype) || itype == OPCODE_JUMP || itype == OPCODE_JALR || itype == OPCODE_RET;
+}
+
+/* Function to check if an instruction takes its target from the
+ * indirect predictor, RET does so only without a return address stack
+ *
+ */
+static int
+check_indirect_jump(int itype)
+{
+	return itype == OPCODE_JUMP || itype == OPCODE_JALR || (itype == OPCODE_RET && !RETURN_ADDRESS_STACK);
+}
+
+/* Function to push a return address, a full stack loses its oldest
+ * entry
+ *
+ */
+static void
+ras_push(RAS *ras, int pc)
+{
+	ras->top = (ras->top + 1) % RAS_SIZE;
+	ras->entries[ras->top] = pc;
+}
+
+/* Function to pop the predicted return address
+ *
+ */
+static int
+ras_pop(RAS *ras)
+{
+	int pc = ras->entries[ras->top];
+
+	ras->top = (ras->top + RAS_SIZE - 1) % RAS_SIZE;
+	return pc;
+}
+
+/* Function to put the global history and the return address stack
+ * back to the state fetch saw before a control transfer
+ *
+ */
+static void
+restore_prediction_checkpoint(APEX_CPU *cpu, const BRANCH_PREDICTION *prediction)
+{
+	cpu->bpred.history = prediction->history;
+	cpu->tpred.ras.top = prediction->ras_top;
+	cpu->tpred.ras.entries[prediction->ras_top] = prediction->ras_value;
+}
+
+/* Function to restore the rename table from the checkpoint a rob
+ * entry took at dispatch. A mapping to an entry that has retired since
+ * goes back to the architectural register, the registers still mapped
+ * are no longer renamed by the squashed writers
+ *
+ */
+static void
+restore_rename_checkpoint(APEX_CPU *cpu, int rob_id)
+{
+	memcpy(cpu->rename_table, cpu->rb.entries[rob_id].rename_checkpoint, sizeof(RENAME_TABLE) * REG_FILE_SIZE);
+	for(int i = 0; i < REG_FILE_SIZE; i++)
 	{
-		cpu->phys_regs[cpu->writeback_mu.iq_entry.dest].al = UN_ALLOCATED;
-		cpu->phys_regs[cpu->writeback_mu.iq_entry.dest].renamed = NOT_RENAMED;
-		cpu->phys_regs[cpu->writeback_mu.iq_entry.dest].status = INVALID;
-		cpu->phys_regs[cpu->writeback_mu.iq_entry.dest].value = 0;
-		cpu->phys_regs[cpu->writeback_mu.iq_entry.dest].p_flag = 0;
-		cpu->phys_regs[cpu->writeback_mu.iq_entry.dest].z_flag = 0;
-		cpu->phys_regs[cpu->writeback_mu.iq_entry.dest].wbv.BYTE = 0;
+		RENAME_TABLE *map = &cpu->rename_table[i];
 
-		cpu->rename_table[cpu->writeback_mu.iq_entry.rd].src_bit = cpu->backup_rename_table[cpu->writeback_mu.iq_entry.rd].src_bit;
-		cpu->rename_table[cpu->writeback_mu.iq_entry.rd].slot_id = cpu->backup_rename_table[cpu->writeback_mu.iq_entry.rd].slot_id;
-		if(cpu->backup_rename_table[cpu->writeback_mu.iq_entry.rd].src_bit == 1)
+		if(map->src_bit == 1 && (map->slot_id - cpu->rb.front + ROB_SIZE) % ROB_SIZE >= cpu->rb.size)
 		{
-			cpu->phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->writeback_mu.iq_entry.rd].slot_id].phy_address] =
-					cpu->backup_phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->writeback_mu.iq_entry.rd].slot_id].phy_address];
+			map->src_bit = 0;
+			map->slot_id = i;
 		}
-		else
+		else if(map->src_bit == 1 && i < REG_FILE_SIZE - 1)
 		{
-			cpu->arch_regs[cpu->backup_rename_table[cpu->writeback_mu.iq_entry.rd].slot_id] = cpu->backup_arch_regs[cpu->backup_rename_table[cpu->writeback_mu.iq_entry.rd].slot_id];
+			cpu->phys_regs[cpu->rb.entries[map->slot_id].phy_address].renamed = NOT_RENAMED;
 		}
-		cpu->writeback_mu.has_insn = 0;
 	}
+}
 
-	if(cpu->execute_load_store.has_insn == 1 && cpu->execute_load_store.lsq_entry.cycle > clock
-	   && cpu->execute_load_store.lsq_entry.cycle <= cpu->clock)
+/* Function to check if any unit of the functional unit pool
+ * holds an instruction
+ *
+ */
+static int
+fu_pool_busy(APEX_CPU *cpu)
+{
+	for(int u = 0; u < NUM_FUS; u++)
 	{
-		if(cpu->execute_load_store.lsq_entry.ls_bit == 0)
+		for(int k = 0; k < cpu->fu_pool[u].slots; k++)
 		{
-			cpu->phys_regs[cpu->execute_load_store.lsq_entry.dest].al = UN_ALLOCATED;
-			cpu->phys_regs[cpu->execute_load_store.lsq_entry.dest].renamed = NOT_RENAMED;
-			cpu->phys_regs[cpu->execute_load_store.lsq_entry.dest].status = INVALID;
-			cpu->phys_regs[cpu->execute_load_store.lsq_entry.dest].value = 0;
-			cpu->phys_regs[cpu->execute_load_store.lsq_entry.dest].p_flag = 0;
-			cpu->phys_regs[cpu->execute_load_store.lsq_entry.dest].z_flag = 0;
-			cpu->phys_regs[cpu->execute_load_store.lsq_entry.dest].wbv.BYTE = 0;
-
-			cpu->rename_table[cpu->execute_load_store.lsq_entry.rd].src_bit = cpu->backup_rename_table[cpu->execute_load_store.lsq_entry.rd].src_bit;
-			cpu->rename_table[cpu->execute_load_store.lsq_entry.rd].slot_id = cpu->backup_rename_table[cpu->execute_load_store.lsq_entry.rd].slot_id;
-			if(cpu->backup_rename_table[cpu->execute_load_store.lsq_entry.rd].src_bit == 1)
-			{
-				cpu->phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->execute_load_store.lsq_entry.rd].slot_id].phy_address] =
-						cpu->backup_phys_regs[cpu->rb.entries[cpu->backup_rename_table[cpu->execute_load_store.lsq_entry.rd].slot_id].phy_address];
-			}
-			else
+			if(cpu->execute_fu[u][k].has_insn)
 			{
-				cpu->arch_regs[cpu->backup_rename_table[cpu->execute_load_store.lsq_entry.rd].slot_id] = cpu->backup_arch_regs[cpu->backup_rename_table[cpu->execute_load_store.lsq_entry.rd].slot_id];
+				return TRUE;
 			}
 		}
-
-		cpu->execute_load_store.has_insn = 0;
 	}
+	return FALSE;
+}
 
-	if(cpu->execute_bu.has_insn == 1 && cpu->execute_bu.iq_entry.cycle > clock && cpu->execute_bu.iq_entry.cycle <= cpu->clock)
+/* Function to check if any branch unit holds a branch
+ *
+ */
+static int
+branch_units_busy(APEX_CPU *cpu)
+{
+	for(int b = 0; b < NUM_BU_UNITS; b++)
 	{
-		cpu->execute_bu.has_insn = 0;
+		if(cpu->execute_bu[b].has_insn)
+		{
+			return TRUE;
+		}
 	}
+	return FALSE;
 }
 
-/* Function to check the dependency of register to register
- * instructions
+/* Function to check if any load/store pipe holds an access
  *
  */
-static void
-check_r_to_r_instruction_dependency(APEX_CPU *cpu)
+static int
+load_store_pipes_busy(APEX_CPU *cpu)
 {
-	int id, rob_id;
-	id = get_free_issue_queue_entry(cpu);
-	rob_id = get_free_rob_entry(cpu);
-	if(id == -1 || rob_id == -1)
+	for(int p = 0; p < NUM_LS_PIPES; p++)
 	{
-		if(cpu->rename2_dispatch.opcode == OPCODE_HALT)
+		if(cpu->execute_load_store[p].has_insn)
 		{
-			printf("Issue queue is full at HALT\n");
+			return TRUE;
 		}
-		cpu->d_stall = 1;
-	}
-	else
-	{
-		update_issue_queue_entry(id, -1, rob_id, cpu);
-		update_rob_entry(rob_id, cpu);
-		cpu->d_stall = 0;
 	}
+	return FALSE;
 }
 
-/* Function to check the dependency of LOAD STORE instructions
+/* Function to check if a source operand carries a poisoned value
+ * during runahead, src tells whether tag is a rob slot or an
+ * architectural register
  *
  */
-static void
-check_load_store_instruction_dependency(APEX_CPU *cpu)
+static int
+check_source_poisoned(APEX_CPU *cpu, int src, int tag)
 {
-	int id, lid, rob_id;
-	id = get_free_issue_queue_entry(cpu);
-	lid = get_free_load_store_queue_entry(cpu);
-	rob_id = get_free_rob_entry(cpu);
-	if(id == -1 || lid == -1 || rob_id == -1)
+	if(!cpu->runahead.active || tag < 0)
 	{
-		cpu->d_stall = 1;
+		return FALSE;
 	}
-	else
+	return src ? cpu->rb.entries[tag].poisoned : cpu->arch_regs[tag].poisoned;
+}
+
+/* Function to poison the result of an instruction writing back
+ * during runahead if any of its sources is poisoned
+ *
+ */
+static int
+runahead_poison_result(APEX_CPU *cpu, const IQ_Entry *entry)
+{
+	int poisoned = check_source_poisoned(cpu, entry->src1_src, entry->src1_tag) ||
+				   check_source_poisoned(cpu, entry->src2_src, entry->src2_tag);
+
+	cpu->rb.entries[entry->rob_id].poisoned = poisoned;
+	if(poisoned)
 	{
-		update_issue_queue_entry(id, lid, rob_id, cpu);
-		update_load_store_queue_entry(lid, rob_id, cpu);
-		update_rob_entry(rob_id, cpu);
-		cpu->d_stall = 0;
+		cpu->runahead.poisoned++;
 	}
+	return poisoned;
 }
 
-/* Function to get the free btb entry
+/* Function to find the MSHR a load at the rob head is waiting
+ * in, returns the MSHR and the position of the load in it
  *
  */
-static int get_free_btb_entry(APEX_CPU *cpu)
+static int
+find_head_load_miss(APEX_CPU *cpu, int *target)
 {
-	int id = -1;
-	for(int i = 0; i < BTB_SIZE; i++)
+	if(cpu->rb.size == 0 || cpu->rb.entries[cpu->rb.front].itype != OPCODE_LOAD ||
+	   cpu->rb.entries[cpu->rb.front].status == VALID)
 	{
-		if(cpu->btb.entries[i].al == UN_ALLOCATED)
+		return -1;
+	}
+	for(int i = 0; i < NUM_MSHRS; i++)
+	{
+		for(int t = 0; cpu->mshr.entries[i].valid && t < cpu->mshr.entries[i].num_targets; t++)
 		{
-			id = i;
-			cpu->btb.entries[i].al = ALLOCATED;
-			cpu->btb.entries[i].history = -1;
-			cpu->btb.entries[i].prediction = 1;
-			cpu->btb.entries[i].resolved = 0;
-			cpu->btb.entries[i].tag = cpu->decode_rename1.pc;
-			cpu->btb.entries[i].type = cpu->decode_rename1.opcode;
-			cpu->btb.entries[i].target = -1;
-			break;
+			if(cpu->mshr.entries[i].targets[t].rob_id == cpu->rb.front)
+			{
+				*target = t;
+				return i;
+			}
 		}
 	}
-	return id;
+	return -1;
 }
 
-/* Function to check for any unresolved branch instruction
- * in the pipeline
+/* Function to enter and leave runahead mode. A load miss blocking
+ * the rob head checkpoints the architectural registers and leaves
+ * its MSHR with a poisoned result so that younger instructions can
+ * pseudo-retire. Once the miss returns the checkpoint is restored
+ * and execution restarts from the load, which now hits
  *
  */
-static int check_unresolved_btb_entry(APEX_CPU *cpu)
+static void
+update_runahead_mode(APEX_CPU *cpu)
 {
-	int id = -1;
-	if(cpu->execute_bu.has_insn == 1)
+	int target = 0;
+	int mshr_id;
+	int p = 0;
+	MSHR_Entry *mshr;
+	MEM_FU_Stage stage;
+
+	if(cpu->runahead.active && cpu->clock >= cpu->runahead.exit_cycle)
 	{
-		return cpu->execute_bu.iq_entry.btb_id;
+		cpu->runahead.active = FALSE;
+		cpu->runahead.resuming = TRUE;
+		cpu->runahead.cycles += cpu->clock - cpu->runahead.start_cycle;
+		memcpy(cpu->arch_regs, cpu->runahead.checkpoint_regs, sizeof(ARCH_REG) * REG_FILE_SIZE);
+		flush_all_instructions(cpu, cpu->runahead.checkpoint_pc);
+		return;
 	}
 
-	if(cpu->writeback_bu.has_insn == 1)
+	mshr_id = find_head_load_miss(cpu, &target);
+	while(p < NUM_LS_PIPES && cpu->writeback_load[p].has_insn)
 	{
-		return cpu->writeback_bu.iq_entry.btb_id;
+		p++;
 	}
-
-	for(int i = 0; i < IQ_SIZE; i++)
+	if(mshr_id < 0 || p == NUM_LS_PIPES)
 	{
-		if(cpu->iq.entries[i].al == ALLOCATED &&
-		  (cpu->iq.entries[i].fu_type == OPCODE_JUMP ||
-		   cpu->iq.entries[i].fu_type == OPCODE_JALR ||
-		   cpu->iq.entries[i].fu_type == OPCODE_BP ||
-		   cpu->iq.entries[i].fu_type == OPCODE_BNP ||
-		   cpu->iq.entries[i].fu_type == OPCODE_BZ ||
-		   cpu->iq.entries[i].fu_type == OPCODE_BNZ))
+		return;
+	}
+	mshr = &cpu->mshr.entries[mshr_id];
+	if(!cpu->runahead.active)
+	{
+		/* The load restarted by the last episode always waits for its
+		 * miss, runahead prefetches may have evicted its line again */
+		if(cpu->runahead.resuming || mshr->ready_cycle < cpu->clock + RUNAHEAD_MIN_CYCLES)
 		{
-			id = i;
-			break;
+			return;
 		}
+		cpu->runahead.active = TRUE;
+		cpu->runahead.checkpoint_pc = cpu->rb.entries[cpu->rb.front].pc;
+		memcpy(cpu->runahead.checkpoint_regs, cpu->arch_regs, sizeof(ARCH_REG) * REG_FILE_SIZE);
+		cpu->runahead.start_cycle = cpu->clock;
+		cpu->runahead.exit_cycle = mshr->ready_cycle;
+		cpu->runahead.episodes++;
+	}
+
+	/* Any miss reaching the head during runahead is skipped the same
+	 * way, the line keeps filling the cache */
+	memset(&stage, 0, sizeof(MEM_FU_Stage));
+	stage.has_insn = 1;
+	stage.lsq_id = -1;
+	stage.rob_id = cpu->rb.front;
+	stage.lsq_entry = mshr->targets[target];
+	stage.lsq_entry.poisoned = TRUE;
+	stage.latch.reg_id = cpu->rb.front;
+	stage.latch.ready = VALID;
+	cpu->writeback_load[p] = stage;
+
+	mshr->num_targets--;
+	memmove(&mshr->targets[target], &mshr->targets[target + 1], (mshr->num_targets - target) * sizeof(LSQ_Entry));
+	if(mshr->num_targets == 0)
+	{
+		mshr->valid = FALSE;
 	}
-	return id;
 }
 
-/* Function to check for btb entries in parallel with fetch
+/* Function to write the buffered memory trace records to the trace file
  *
  */
-static int check_btb_entries(APEX_CPU *cpu, int pc)
+static void
+mem_trace_flush(APEX_CPU *cpu)
 {
-	int id = -1;
-	for(int i = 0; i < BTB_SIZE; i++)
+	if(cpu->mem_trace.file && cpu->mem_trace.count)
 	{
-		if(cpu->btb.entries[i].al == ALLOCATED && cpu->btb.entries[i].tag == pc)
-		{
-			id = i;
-			break;
-		}
+		fwrite(cpu->mem_trace.records, sizeof(MEM_TRACE_Record), cpu->mem_trace.count, cpu->mem_trace.file);
 	}
-	return id;
+	cpu->mem_trace.written += cpu->mem_trace.count;
+	cpu->mem_trace.count = 0;
 }
 
-/*
- * Fetch Stage of APEX Pipeline
+/* Function to add one committed LOAD/STORE to the memory trace
  *
- * Note: You are free to edit this function according to your implementation
  */
 static void
-APEX_fetch(APEX_CPU *cpu)
+mem_trace_record(APEX_CPU *cpu, int pc, int address, int is_store)
 {
-    APEX_Instruction *current_ins;
-    int id;
-    if(cpu->stall)
-    {
-        if(!prev_stage)
-        {
-            /* Store current PC in fetch latch */
-
-            cpu->fetch.pc = cpu->pc;
-
-            /* Index into code memory using this pc and copy all instruction fields
-            * into fetch latch  */
-            current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-            strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-            cpu->fetch.opcode = current_ins->opcode;
-            cpu->fetch.rd = current_ins->rd;
-            cpu->fetch.rs1 = current_ins->rs1;
-            cpu->fetch.rs2 = current_ins->rs2;
-            cpu->fetch.imm = current_ins->imm;
-            cpu->fetch.btb_id = -1;
-            printf("Fetch at address = %d\n", cpu->pc);
-            /* Update PC for next instruction */
-            cpu->pc += INSTRUCTION_SIZE;
-
-            id = check_btb_entries(cpu, cpu->pc);
-    		cpu->fetch.btb_id = id;
-        	if(id >= 0)
-        	{
-        		if(cpu->btb.entries[id].resolved == 1)
-        		{
-        			if(cpu->btb.entries[id].history == 1)
-        			{
-            			cpu->pc = cpu->btb.entries[id].target;
-            			cpu->btb.entries[id].prediction = 1;
-            			cpu->btb.entries[id].resolved = 0;
-            			cpu->fetch_from_next_cycle = TRUE;
-        			}
-        			else
-        			{
-        				cpu->btb.entries[id].prediction = 0;
-            			cpu->btb.entries[id].resolved = 0;
-        			}
-        		}
-        	}
-            /* Copy data from fetch latch to debug fetch latch*/
-            cpu->debug_fetch = cpu->fetch;
-            
-            /* Stop fetching new instructions if HALT is fetched */
-            if (cpu->fetch.opcode == OPCODE_HALT)
-            {
-                last_halt = TRUE;
-            }
-        }
-        else
-        {
-            /* Copy data from fetch latch to debug fetch latch*/
-        	cpu->debug_fetch = cpu->fetch;
-        }
-    }
-    else
-    {
-        if(prev_stage)
-        {
-            /* Copy data from fetch latch to decode latch*/
-            cpu->decode_rename1 = cpu->fetch;
-            /* Copy data from fetch latch to debug fetch latch*/
-            cpu->debug_fetch = cpu->fetch;
-            if(last_halt)
-            {
-                last_halt = FALSE;
-                cpu->fetch.has_insn = FALSE;
-                return;
-            }
-        }
-        else
-        {
-            if (cpu->fetch.has_insn)
-            {
-                /* This fetches new branch target instruction from next cycle */
-                if (cpu->fetch_from_next_cycle == TRUE)
-                {
-                    cpu->fetch_from_next_cycle = FALSE;
-                    cpu->debug_fetch.has_insn = FALSE;
-                    /* Skip this cycle*/
-                    return;
-                }
-
-                /* Store current PC in fetch latch */
-                cpu->fetch.pc = cpu->pc;
-
-                /* Index into code memory using this pc and copy all instruction fields
-                * into fetch latch  */
-                current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-                strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-                cpu->fetch.opcode = current_ins->opcode;
-                cpu->fetch.rd = current_ins->rd;
-                cpu->fetch.rs1 = current_ins->rs1;
-                cpu->fetch.rs2 = current_ins->rs2;
-                cpu->fetch.imm = current_ins->imm;
-                cpu->fetch.btb_id = -1;
-                printf("Fetch at address = %d\n", cpu->pc);
-                cpu->pc += INSTRUCTION_SIZE;
-
-                id = check_btb_entries(cpu, cpu->pc);
-        		cpu->fetch.btb_id = id;
-            	if(id >= 0)
-            	{
-            		printf("BTB Hit\n");
-            		if(cpu->btb.entries[id].resolved == 1)
-            		{
-            			if(cpu->btb.entries[id].history == 1)
-            			{
-                			cpu->pc = cpu->btb.entries[id].target;
-                			cpu->btb.entries[id].prediction = 1;
-                			cpu->btb.entries[id].resolved = 0;
-                			cpu->fetch_from_next_cycle = TRUE;
-            			}
-            			else
-            			{
-            				cpu->btb.entries[id].prediction = 0;
-                			cpu->btb.entries[id].resolved = 0;
-            			}
-            		}
-            	}
-
-                /* Copy data from fetch latch to decode latch*/
-                cpu->decode_rename1 = cpu->fetch;
+	MEM_TRACE_Record *record = &cpu->mem_trace.records[cpu->mem_trace.count++];
 
-                /* Copy data from fetch latch to debug fetch latch*/
-                cpu->debug_fetch = cpu->fetch;
-
-                /* Stop fetching new instructions if HALT is fetched */
-                if (cpu->fetch.opcode == OPCODE_HALT)
-                {
-                    cpu->fetch.has_insn = FALSE;
-                }
-            }
-            else
-            {
-            	cpu->debug_fetch = cpu->fetch;
-            }
-        }
-    }
-    prev_stage = cpu->stall;
+	record->cycle = cpu->clock;
+	record->pc = pc;
+	record->address = address | (is_store ? MEM_TRACE_STORE : 0);
+	if(cpu->mem_trace.count == MEM_TRACE_BUFFER_SIZE)
+	{
+		mem_trace_flush(cpu);
+	}
 }
 
-/*
- * Decode/Rename1 Stage of APEX Pipeline
+/* Function to retire the rob head, during runahead it pseudo-retires
+ * into the checkpointed architectural file. Returns TRUE if the head
+ * left the rob, *halted is set when it was the HALT
  *
- * Note: You are free to edit this function according to your implementation
  */
-static void
-APEX_decode_rename1(APEX_CPU *cpu)
+static int retire_rob_head(APEX_CPU *cpu, int *halted)
 {
-	int reg = -1;
-	if(cpu->d_stall == 1)
-	{
-		cpu->stall = 1;
-        /* Copy data from decode latch to debug decode latch*/
-        cpu->debug_decode_rename1 = cpu->decode_rename1;
-        return;
-	}
-	else
+	if(cpu->rb.size > 0 && cpu->rb.entries[cpu->rb.front].excodes == -1)
 	{
-		cpu->stall = 0;
-	}
-    if (cpu->decode_rename1.has_insn)
-    {
-        /* Read operands from register file based on the instruction type */
-        switch (cpu->decode_rename1.opcode)
-        {
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_MUL:
-            case OPCODE_DIV:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            {
-            	reg = get_free_physical_register(cpu);
-            	if(reg >= 0)
-            	{
-            		cpu->decode_rename1.p1 = cpu->rename_table[cpu->decode_rename1.rs1].slot_id;
-                	cpu->decode_rename1.p2 = cpu->rename_table[cpu->decode_rename1.rs2].slot_id;
-                	cpu->decode_rename1.pd = reg;
-                	allocate_physical_register(cpu, reg);
-                	cpu->stall = 0;
-            	}
-            	else
+		if(cpu->rb.entries[cpu->rb.front].itype == OPCODE_HALT)
+		{
+			if(!cpu->runahead.active && !fu_pool_busy(cpu) && !branch_units_busy(cpu) && !load_store_pipes_busy(cpu) &&
+			   cpu->iq.size == 0 && cpu->lsq.size == 0 && cpu->store_buffer.size == 0)
+			{
+				cpu->rb.front = (cpu->rb.front + 1) % ROB_SIZE;
+				cpu->rb.size--;
+				cpu->insn_completed++;
+				*halted = TRUE;
+				return TRUE;
+			}
+		}
+		else if(cpu->rb.entries[cpu->rb.front].status == VALID &&
+		  (cpu->rb.entries[cpu->rb.front].itype == OPCODE_ADD  ||
+		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_SUB  ||
+		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_MUL  ||
+		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_DIV  ||
+		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_AND  ||
+		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_OR   ||
+		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_XOR  ||
+		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_MOVC ||
+		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_LOAD ||
+		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_ADDL ||
+		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_SUBL ||
+		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_CMP  ||
+		   cpu->rb.entries[cpu->rb.front].itype == OPCODE_JALR))
+		{
+			/* The architectural file always holds the committed state,
+			 * a full flush restarts from it */
+			cpu->arch_regs[cpu->rb.entries[cpu->rb.front].arch_address].value = cpu->phys_regs[cpu->rb.entries[cpu->rb.front].phy_address].value;
+			cpu->arch_regs[cpu->rb.entries[cpu->rb.front].arch_address].z_flag = cpu->phys_regs[cpu->rb.entries[cpu->rb.front].phy_address].z_flag;
+			cpu->arch_regs[cpu->rb.entries[cpu->rb.front].arch_address].p_flag = cpu->phys_regs[cpu->rb.entries[cpu->rb.front].phy_address].p_flag;
+			cpu->arch_regs[cpu->rb.entries[cpu->rb.front].arch_address].poisoned = cpu->rb.entries[cpu->rb.front].poisoned;
+			if(cpu->phys_regs[cpu->rb.entries[cpu->rb.front].phy_address].renamed != RENAMED)
+			{
+				cpu->rename_table[cpu->rb.entries[cpu->rb.front].arch_address].src_bit = 0;
+				cpu->rename_table[cpu->rb.entries[cpu->rb.front].arch_address].slot_id = cpu->rb.entries[cpu->rb.front].arch_address;
+			}
+			if(check_flag_setter(cpu->rb.entries[cpu->rb.front].itype))
+			{
+				/* Flags are committed like any other register */
+				cpu->arch_regs[REG_FILE_SIZE - 1].value = cpu->phys_regs[cpu->rb.entries[cpu->rb.front].phy_address].value;
+				cpu->arch_regs[REG_FILE_SIZE - 1].z_flag = cpu->phys_regs[cpu->rb.entries[cpu->rb.front].phy_address].z_flag;
+				cpu->arch_regs[REG_FILE_SIZE - 1].p_flag = cpu->phys_regs[cpu->rb.entries[cpu->rb.front].phy_address].p_flag;
+				cpu->arch_regs[REG_FILE_SIZE - 1].poisoned = cpu->rb.entries[cpu->rb.front].poisoned;
+				if(cpu->rename_table[REG_FILE_SIZE - 1].src_bit == 1 && cpu->rename_table[REG_FILE_SIZE - 1].slot_id == cpu->rb.front)
+				{
+					cpu->rename_table[REG_FILE_SIZE - 1].src_bit = 0;
+					cpu->rename_table[REG_FILE_SIZE - 1].slot_id = REG_FILE_SIZE - 1;
+				}
+			}
+			if(cpu->rb.entries[cpu->rb.front].itype == OPCODE_JALR && !cpu->runahead.active)
+			{
+				ras_push(&cpu->tpred.retired_ras, cpu->rb.entries[cpu->rb.front].pc + INSTRUCTION_SIZE);
+			}
+			/* Wrong path and runahead loads never get here, only
+			 * committed loads go to the trace */
+			if(MEM_TRACE && cpu->rb.entries[cpu->rb.front].itype == OPCODE_LOAD && !cpu->runahead.active)
+			{
+				mem_trace_record(cpu, cpu->rb.entries[cpu->rb.front].pc, cpu->rb.entries[cpu->rb.front].mem_address, FALSE);
+			}
+			free_physical_register(cpu, cpu->rb.entries[cpu->rb.front].phy_address);
+			cpu->rb.front = (cpu->rb.front + 1) % ROB_SIZE;
+			cpu->rb.size--;
+			if(cpu->runahead.active)
+			{
+				cpu->runahead.pseudo_retired++;
+			}
+			else
+			{
+				cpu->runahead.resuming = FALSE;
+				cpu->insn_completed++;
+			}
+			return TRUE;
+		}
+		else if(cpu->rb.entries[cpu->rb.front].status == VALID)
+		{
+			/* Runahead stores never write memory, they are dropped
+			 * from the store buffer when the checkpoint is restored */
+			if(cpu->rb.entries[cpu->rb.front].itype == OPCODE_STORE && !cpu->runahead.active)
+			{
+				store_buffer_commit(cpu, cpu->rb.front);
+			}
+			/* Runahead leaves the history of the checkpoint in place */
+			if(check_conditional_branch(cpu->rb.entries[cpu->rb.front].itype) && !cpu->runahead.active)
+			{
+				cpu->bpred.retired_history = (cpu->bpred.retired_history << 1) | cpu->rb.entries[cpu->rb.front].taken;
+			}
+			if(cpu->rb.entries[cpu->rb.front].itype == OPCODE_RET && !cpu->runahead.active)
+			{
+				ras_pop(&cpu->tpred.retired_ras);
+			}
+			cpu->rb.front = (cpu->rb.front + 1) % ROB_SIZE;
+			cpu->rb.size--;
+			if(cpu->runahead.active)
+			{
+				cpu->runahead.pseudo_retired++;
+			}
+			else
+			{
+				cpu->insn_completed++;
+			}
+			return TRUE;
+		}
+	}
+	else if(cpu->rb.size > 0 && cpu->rb.entries[cpu->rb.front].excodes == EXCODE_MEMORY_ORDER_VIOLATION &&
+			cpu->rb.entries[cpu->rb.front].status == VALID)
+	{
+		/* Everything older has retired, re-execute the load */
+		flush_all_instructions(cpu, cpu->rb.entries[cpu->rb.front].pc);
+	}
+	return FALSE;
+}
+
+/* Function to retire up to COMMIT_WIDTH completed rob entries in
+ * program order, returns 1 once the HALT has retired
+ *
+ */
+static int rob_retirement_logic(APEX_CPU *cpu)
+{
+	int retired = 0;
+	int halted = FALSE;
+
+	if(RUNAHEAD_EXECUTION)
+	{
+		update_runahead_mode(cpu);
+	}
+	while(retired < COMMIT_WIDTH && !halted && retire_rob_head(cpu, &halted))
+	{
+		retired++;
+	}
+	if(retired > 0 && !cpu->runahead.active)
+	{
+		cpu->rb.commit_cycles++;
+		if(retired == COMMIT_WIDTH)
+		{
+			cpu->rb.full_commit_cycles++;
+		}
+	}
+	return halted;
+}
+
+/* Function to drop an instruction of a squashed rob entry from a
+ * functional unit stage, its destination is freed with the rob entry
+ *
+ */
+static void
+squash_fu_stage(FU_Stage *stage, const unsigned char *squashed)
+{
+	if(stage->has_insn == 1 && squashed[stage->iq_entry.rob_id])
+	{
+		stage->has_insn = 0;
+	}
+}
+
+/* Function to restore the global history and the return address
+ * stack to the checkpoint of the oldest instruction waiting in the
+ * fetch target queue or the fetch buffer
+ *
+ */
+static void
+restore_fetch_queue_state(APEX_CPU *cpu)
+{
+	/* Every instruction of a block not fetched yet holds a checkpoint */
+	for(int i = cpu->ftq.size - 1; i >= 0; i--)
+	{
+		const FTQ_Entry *block = &cpu->ftq.entries[(cpu->ftq.head + i) % FTQ_SIZE];
+		restore_prediction_checkpoint(cpu, &block->predictions[block->fetched]);
+	}
+	for(int i = cpu->fetch_buffer.size - 1; i >= 0; i--)
+	{
+		const CPU_Stage *stage = &cpu->fetch_buffer.entries[(cpu->fetch_buffer.head + i) % FETCH_BUFFER_SIZE];
+		if(check_control_transfer(stage->opcode))
+		{
+			restore_prediction_checkpoint(cpu, &stage->prediction);
+		}
+	}
+}
+
+/* Function to restore the global history and the return address
+ * stack to the checkpoint of the oldest control transfer removed by a
+ * flush of the rob entries younger than rob_id, both are unchanged
+ * when none is removed.
+ * Instructions are visited from the youngest, so the oldest one is the
+ * last found
+ *
+ */
+static void
+restore_predictor_state(APEX_CPU *cpu, int rob_id)
+{
+	const CPU_Stage *groups[] = {cpu->decode_rename1, cpu->rename2_dispatch};
+
+	restore_fetch_queue_state(cpu);
+	for(int g = 0; g < 2; g++)
+	{
+		for(int w = FRONTEND_WIDTH - 1; w >= 0; w--)
+		{
+			if(groups[g][w].has_insn && check_control_transfer(groups[g][w].opcode))
+			{
+				restore_prediction_checkpoint(cpu, &groups[g][w].prediction);
+			}
+		}
+	}
+	/* Several branches can be in flight, resolved or not, the rob
+	 * holds the checkpoint of each one dispatched */
+	for(int i = cpu->rb.rear; cpu->rb.size > 0 && i != rob_id; i = (i + ROB_SIZE - 1) % ROB_SIZE)
+	{
+		if(check_control_transfer(cpu->rb.entries[i].itype))
+		{
+			restore_prediction_checkpoint(cpu, &cpu->rb.entries[i].prediction);
+		}
+	}
+}
+
+/* Function to flush the instructions younger than the rob entry of
+ * a branch, or of a load whose value was mispredicted. The rob is
+ * rewound to the entry, everything else in flight is squashed by the
+ * rob entries removed and the rename table is restored from the
+ * checkpoint the entry took at dispatch
+ *
+ */
+static void
+flush_instructions_after_branch(APEX_CPU *cpu, int rob_id, int target)
+{
+	unsigned char squashed[ROB_SIZE] = {0};
+
+	restore_predictor_state(cpu, rob_id);
+	while(cpu->rb.size > 0 && cpu->rb.rear != rob_id)
+	{
+		if (ENABLE_DEBUG_MESSAGES)
+		{
+			printf("ROB entry deleted from rear = %d\n", cpu->rb.rear);
+		}
+		squashed[cpu->rb.rear] = TRUE;
+		free_physical_register(cpu, cpu->rb.entries[cpu->rb.rear].phy_address);
+		cpu->rb.rear = (cpu->rb.rear + ROB_SIZE - 1) % ROB_SIZE;
+		cpu->rb.size--;
+	}
+
+	cpu->pc = target;
+	cpu->fetch_halted = FALSE;
+	squash_fetch_queues(cpu);
+	cpu->loop_buffer.state = LOOP_IDLE;
+	squash_front_end_group(cpu, cpu->decode_rename1, 0);
+	squash_front_end_group(cpu, cpu->rename2_dispatch, 0);
+	cpu->stall = 0;
+	cpu->d_stall = 0;
+
+	for(int i = 0; i < IQ_SIZE; i++)
+	{
+		if(cpu->iq.entries[i].al == ALLOCATED && squashed[cpu->iq.entries[i].rob_id])
+		{
+			cpu->iq.entries[i].al = UN_ALLOCATED;
+			cpu->iq.size--;
+		}
+	}
+
+	/* The LSQ is in program order, the squashed entries are its tail */
+	while(cpu->lsq.size > 0 && squashed[cpu->lsq.entries[cpu->lsq.rear].rob_id])
+	{
+		cpu->lsq.entries[cpu->lsq.rear].al = UN_ALLOCATED;
+		cpu->lsq.rear = (cpu->lsq.rear + LSQ_SIZE - 1) % LSQ_SIZE;
+		cpu->lsq.size--;
+	}
+
+	for(int u = 0; u < NUM_FUS; u++)
+	{
+		for(int k = 0; k < cpu->fu_pool[u].slots; k++)
+		{
+			squash_fu_stage(&cpu->execute_fu[u][k], squashed);
+		}
+		squash_fu_stage(&cpu->writeback_fu[u], squashed);
+	}
+	for(int b = 0; b < NUM_BU_UNITS; b++)
+	{
+		squash_fu_stage(&cpu->execute_bu[b], squashed);
+		squash_fu_stage(&cpu->writeback_bu[b], squashed);
+	}
+
+	for(int p = 0; p < NUM_AGU_PIPES; p++)
+	{
+		if(cpu->execute_agu[p].has_insn == 1 && squashed[cpu->execute_agu[p].iq_entry.rob_id])
+		{
+			cpu->execute_agu[p].has_insn = 0;
+		}
+	}
+
+	for(int p = 0; p < NUM_LS_PIPES; p++)
+	{
+		if(cpu->execute_load_store[p].has_insn == 1 && squashed[cpu->execute_load_store[p].lsq_entry.rob_id])
+		{
+			cpu->execute_load_store[p].has_insn = 0;
+		}
+		if(cpu->writeback_load[p].has_insn == 1 && squashed[cpu->writeback_load[p].lsq_entry.rob_id])
+		{
+			cpu->writeback_load[p].has_insn = 0;
+		}
+	}
+
+	for(int i = 0; i < NUM_MSHRS; i++)
+	{
+		MSHR_Entry *mshr = &cpu->mshr.entries[i];
+		int j = 0;
+		while(mshr->valid && j < mshr->num_targets)
+		{
+			if(squashed[mshr->targets[j].rob_id])
+			{
+				mshr->num_targets--;
+				memmove(&mshr->targets[j], &mshr->targets[j + 1], (mshr->num_targets - j) * sizeof(LSQ_Entry));
+			}
+			else
+			{
+				j++;
+			}
+		}
+		if(mshr->num_targets == 0)
+		{
+			/* The fill itself stays in the cache */
+			mshr->valid = FALSE;
+		}
+	}
+
+	store_buffer_squash(cpu, squashed);
+	restore_rename_checkpoint(cpu, rob_id);
+}
+
+/* Function to check the dependency of register to register
+ * instructions
+ *
+ */
+static void
+check_r_to_r_instruction_dependency(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+	int id, rob_id;
+	id = get_free_issue_queue_entry(cpu);
+	if(id == -1 || cpu->rb.size == ROB_SIZE)
+	{
+		if(stage->opcode == OPCODE_HALT)
+		{
+			printf("Issue queue is full at HALT\n");
+		}
+		cpu->d_stall = 1;
+	}
+	else
+	{
+		rob_id = get_free_rob_entry(cpu);
+		update_issue_queue_entry(id, -1, rob_id, cpu, stage);
+		update_rob_entry(rob_id, cpu, stage);
+		cpu->d_stall = 0;
+	}
+}
+
+/* Function to get the SSIT index of a load/store pc
+ *
+ */
+static int
+get_ssit_index(int pc)
+{
+	return ((pc - PC_START) / INSTRUCTION_SIZE) % SSIT_SIZE;
+}
+
+/* Function to check if the store a load was predicted to depend
+ * on is still waiting in the LSQ
+ *
+ */
+static int
+check_store_set_dependency(APEX_CPU *cpu, int lid)
+{
+	int sid = cpu->lsq.entries[lid].ss_lsq_id;
+	return sid >= 0 && cpu->lsq.entries[sid].al == ALLOCATED && !cpu->lsq.entries[sid].issued &&
+		   cpu->lsq.entries[sid].rob_id == cpu->lsq.entries[lid].ss_rob_id;
+}
+
+/* Function to consult the store set predictor for a dispatched
+ * load/store, a load waits for the last dispatched store of its
+ * set and a store becomes the last one of its set
+ *
+ */
+static void
+store_set_dispatch(APEX_CPU *cpu, int lid)
+{
+	LSQ_Entry *entry = &cpu->lsq.entries[lid];
+	int ssid = cpu->store_set.ssit[get_ssit_index(entry->pc)];
+
+	entry->ss_lsq_id = -1;
+	entry->ss_waited = FALSE;
+	if(!STORE_SET_PREDICTOR || ssid < 0)
+	{
+		return;
+	}
+	if(entry->ls_bit == 0 && cpu->store_set.lfst[ssid].valid)
+	{
+		entry->ss_lsq_id = cpu->store_set.lfst[ssid].lsq_id;
+		entry->ss_rob_id = cpu->store_set.lfst[ssid].rob_id;
+		if(!check_store_set_dependency(cpu, lid))
+		{
+			entry->ss_lsq_id = -1;
+		}
+	}
+	else if(entry->ls_bit == 1)
+	{
+		cpu->store_set.lfst[ssid].valid = TRUE;
+		cpu->store_set.lfst[ssid].lsq_id = lid;
+		cpu->store_set.lfst[ssid].rob_id = entry->rob_id;
+	}
+}
+
+/* Function to release the loads waiting on an issuing store and
+ * count the waits that turn out to be for a different address
+ *
+ */
+static void
+store_set_issue(APEX_CPU *cpu, int sid)
+{
+	for(int i = 0; i < LFST_SIZE; i++)
+	{
+		if(cpu->store_set.lfst[i].valid && cpu->store_set.lfst[i].lsq_id == sid &&
+		   cpu->store_set.lfst[i].rob_id == cpu->lsq.entries[sid].rob_id)
+		{
+			cpu->store_set.lfst[i].valid = FALSE;
+		}
+	}
+	for(int i = 0; i < LSQ_SIZE; i++)
+	{
+		if(cpu->lsq.entries[i].al == ALLOCATED && cpu->lsq.entries[i].ls_bit == 0 &&
+		   cpu->lsq.entries[i].ss_lsq_id == sid && cpu->lsq.entries[i].ss_rob_id == cpu->lsq.entries[sid].rob_id)
+		{
+			if(cpu->lsq.entries[i].ss_waited)
+			{
+				cpu->store_set.waits++;
+				if(cpu->lsq.entries[i].mem_valid == VALID && !cpu->lsq.entries[i].bad_address &&
+				   !cpu->lsq.entries[sid].bad_address &&
+				   cpu->lsq.entries[i].mem_address != cpu->lsq.entries[sid].mem_address)
+				{
+					cpu->store_set.false_dependences++;
+				}
+			}
+			cpu->lsq.entries[i].ss_lsq_id = -1;
+		}
+	}
+}
+
+/* Function to put the load and the store of an ordering violation
+ * in the same store set, merging their sets if both have one
+ *
+ */
+static void
+store_set_train(APEX_CPU *cpu, int load_pc, int store_pc)
+{
+	int *load_ssid = &cpu->store_set.ssit[get_ssit_index(load_pc)];
+	int *store_ssid = &cpu->store_set.ssit[get_ssit_index(store_pc)];
+
+	if(*load_ssid < 0 && *store_ssid < 0)
+	{
+		*load_ssid = cpu->store_set.next_ssid;
+		*store_ssid = cpu->store_set.next_ssid;
+		cpu->store_set.next_ssid = (cpu->store_set.next_ssid + 1) % LFST_SIZE;
+	}
+	else if(*load_ssid < 0)
+	{
+		*load_ssid = *store_ssid;
+	}
+	else if(*store_ssid < 0)
+	{
+		*store_ssid = *load_ssid;
+	}
+	else if(*load_ssid < *store_ssid)
+	{
+		*store_ssid = *load_ssid;
+	}
+	else
+	{
+		*load_ssid = *store_ssid;
+	}
+}
+
+/* Function to forget all store sets, called periodically
+ *
+ */
+static void
+store_set_clear(APEX_CPU *cpu)
+{
+	for(int i = 0; i < SSIT_SIZE; i++)
+	{
+		cpu->store_set.ssit[i] = -1;
+	}
+	for(int i = 0; i < LFST_SIZE; i++)
+	{
+		cpu->store_set.lfst[i].valid = FALSE;
+	}
+}
+
+/* Function to get the value predictor entry of a load PC
+ *
+ */
+static LVP_Entry *
+get_lvp_entry(APEX_CPU *cpu, int pc)
+{
+	return &cpu->value_predictor.table[((pc - PC_START) / INSTRUCTION_SIZE) % LVP_TABLE_SIZE];
+}
+
+/* Function to predict the value of a dispatched load. A confident
+ * prediction is written to its destination right away so that the
+ * dependents dispatched after it do not wait for the LSU. Older
+ * instances of the same load still in flight are counted so that
+ * a striding load is predicted as many strides ahead
+ *
+ */
+static void
+predict_load_value(APEX_CPU *cpu, int lid)
+{
+	LSQ_Entry *entry = &cpu->lsq.entries[lid];
+	LVP_Entry *lvp = get_lvp_entry(cpu, entry->pc);
+	int inflight = 0;
+
+	if(entry->ls_bit != 0 || cpu->runahead.active)
+	{
+		return;
+	}
+	cpu->value_predictor.loads++;
+	if(!lvp->valid || lvp->pc != entry->pc || lvp->confidence < LVP_CONFIDENCE_THRESHOLD)
+	{
+		return;
+	}
+	for(int n = 0, i = cpu->rb.front; n < cpu->rb.size; n++, i = (i + 1) % ROB_SIZE)
+	{
+		if(i != entry->rob_id && cpu->rb.entries[i].itype == OPCODE_LOAD && cpu->rb.entries[i].pc == entry->pc &&
+		   cpu->rb.entries[i].status != VALID)
+		{
+			inflight++;
+		}
+	}
+	entry->value_predicted = TRUE;
+	entry->predicted_value = lvp->last_value + lvp->stride * (inflight + 1);
+	cpu->phys_regs[entry->dest].value = entry->predicted_value;
+	cpu->phys_regs[entry->dest].status = VALID;
+	cpu->value_predictor.predicted++;
+}
+
+/* Function to train the value predictor with the value a load
+ * returned, the confidence builds up while the stride repeats
+ *
+ */
+static void
+train_load_value_predictor(APEX_CPU *cpu, int pc, int value)
+{
+	LVP_Entry *lvp = get_lvp_entry(cpu, pc);
+
+	if(!lvp->valid || lvp->pc != pc)
+	{
+		lvp->valid = TRUE;
+		lvp->pc = pc;
+		lvp->stride = 0;
+		lvp->confidence = 0;
+	}
+	else if(value - lvp->last_value == lvp->stride)
+	{
+		if(lvp->confidence < LVP_CONFIDENCE_MAX)
+		{
+			lvp->confidence++;
+		}
+	}
+	else
+	{
+		lvp->stride = value - lvp->last_value;
+		lvp->confidence = 0;
+	}
+	lvp->last_value = value;
+}
+
+/* Function to check the dependency of LOAD STORE instructions,
+ * returns the allocated lsq entry or -1 when dispatch stalls
+ *
+ */
+static int
+check_load_store_instruction_dependency(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+	int id, lid = -1, rob_id;
+	id = get_free_issue_queue_entry(cpu);
+	if(id == -1 || cpu->lsq.size == LSQ_SIZE || cpu->rb.size == ROB_SIZE)
+	{
+		/* Nothing is allocated unless all three have room */
+		cpu->d_stall = 1;
+	}
+	else
+	{
+		lid = get_free_load_store_queue_entry(cpu);
+		rob_id = get_free_rob_entry(cpu);
+		update_issue_queue_entry(id, lid, rob_id, cpu, stage);
+		update_load_store_queue_entry(lid, rob_id, cpu, stage);
+		update_rob_entry(rob_id, cpu, stage);
+		store_set_dispatch(cpu, lid);
+		if(LOAD_VALUE_PREDICTION)
+		{
+			predict_load_value(cpu, lid);
+		}
+		cpu->d_stall = 0;
+	}
+	return lid;
+}
+
+/* Function to get the first way of the btb set of a PC, the
+ * instruction index folded onto itself so that code a multiple of
+ * BTB_SETS instructions apart spreads over the sets
+ *
+ */
+static BTB_Entry *
+get_btb_set(APEX_CPU *cpu, int pc)
+{
+	int index = (pc - PC_START) / INSTRUCTION_SIZE;
+
+	return &cpu->btb.entries[((index ^ (index / BTB_SETS)) & (BTB_SETS - 1)) * BTB_WAYS];
+}
+
+/* Function to check for btb entries in parallel with fetch, only
+ * the ways of one set are searched
+ *
+ */
+static BTB_Entry *
+check_btb_entries(APEX_CPU *cpu, int pc)
+{
+	BTB_Entry *set = get_btb_set(cpu, pc);
+
+	for(int i = 0; i < BTB_WAYS; i++)
+	{
+		if(set[i].al == ALLOCATED && set[i].tag == pc)
+		{
+			return &set[i];
+		}
+	}
+	return NULL;
+}
+
+/* Function to unlink a PC from the shadow btb LRU list
+ *
+ */
+static void
+btb_shadow_unlink(BTB_SHADOW *shadow, int i)
+{
+	if(shadow->prev[i] >= 0)
+	{
+		shadow->next[shadow->prev[i]] = shadow->next[i];
+	}
+	else
+	{
+		shadow->head = shadow->next[i];
+	}
+	if(shadow->next[i] >= 0)
+	{
+		shadow->prev[shadow->next[i]] = shadow->prev[i];
+	}
+	else
+	{
+		shadow->tail = shadow->prev[i];
+	}
+}
+
+/* Function to make a PC the most recently used one of the shadow
+ * btb. A PC not held is only put in when allocate is set, evicting the
+ * least recently used one of a full shadow btb
+ *
+ */
+static void
+btb_shadow_access(APEX_CPU *cpu, int pc, int allocate)
+{
+	BTB_SHADOW *shadow = &cpu->btb.shadow;
+	int i = get_code_memory_index_from_pc(pc);
+
+	if(shadow->held[i])
+	{
+		btb_shadow_unlink(shadow, i);
+	}
+	else if(!allocate)
+	{
+		return;
+	}
+	else
+	{
+		if(shadow->size == BTB_SIZE)
+		{
+			shadow->held[shadow->tail] = FALSE;
+			btb_shadow_unlink(shadow, shadow->tail);
+			shadow->size--;
+		}
+		shadow->held[i] = TRUE;
+		shadow->seen[i] = TRUE;
+		shadow->size++;
+	}
+	shadow->prev[i] = -1;
+	shadow->next[i] = shadow->head;
+	if(shadow->head >= 0)
+	{
+		shadow->prev[shadow->head] = i;
+	}
+	else
+	{
+		shadow->tail = i;
+	}
+	shadow->head = i;
+}
+
+/* Function to look up the target of a control transfer predicted
+ * taken at fetch, returns -1 on a btb miss. A miss is compulsory for a
+ * PC never allocated, a conflict miss when a fully associative btb of
+ * the same size would have hit and a capacity miss otherwise
+ *
+ */
+static int
+predict_btb_target(APEX_CPU *cpu, int pc)
+{
+	BTB_Entry *entry = check_btb_entries(cpu, pc);
+	int i = get_code_memory_index_from_pc(pc);
+
+	cpu->btb.lookups++;
+	if(entry)
+	{
+		cpu->btb.hits++;
+	}
+	else if(!cpu->btb.shadow.seen[i])
+	{
+		cpu->btb.compulsory_misses++;
+	}
+	else if(cpu->btb.shadow.held[i])
+	{
+		cpu->btb.conflict_misses++;
+	}
+	else
+	{
+		cpu->btb.capacity_misses++;
+	}
+	btb_shadow_access(cpu, pc, FALSE);
+	if(entry)
+	{
+		entry->lru = cpu->clock;
+		return entry->target;
+	}
+	return -1;
+}
+
+/* Function to record the target of a taken control transfer in the
+ * btb, a new PC replaces the least recently used way of its set
+ *
+ */
+static void
+update_btb_entry(APEX_CPU *cpu, int pc, int type, int target)
+{
+	BTB_Entry *set = get_btb_set(cpu, pc);
+	BTB_Entry *way = check_btb_entries(cpu, pc);
+
+	if(!way)
+	{
+		way = &set[0];
+		for(int i = 0; i < BTB_WAYS && way->al == ALLOCATED; i++)
+		{
+			if(set[i].al == UN_ALLOCATED || set[i].lru < way->lru)
+			{
+				way = &set[i];
+			}
+		}
+		if(way->al == UN_ALLOCATED)
+		{
+			cpu->btb.size++;
+		}
+		way->al = ALLOCATED;
+		way->tag = pc;
+		way->type = type;
+	}
+	way->target = target;
+	way->lru = cpu->clock;
+	btb_shadow_access(cpu, pc, TRUE);
+}
+
+/* Function to move a 2-bit saturating counter towards the outcome
+ *
+ */
+static void
+update_2bit_counter(unsigned char *counter, int taken)
+{
+	if(taken && *counter < 3)
+	{
+		(*counter)++;
+	}
+	else if(!taken && *counter > 0)
+	{
+		(*counter)--;
+	}
+}
+
+/* Function to get the PC indexed entry of the bimodal and chooser
+ * tables
+ *
+ */
+static int
+get_bimodal_index(int pc)
+{
+	return ((pc - PC_START) / INSTRUCTION_SIZE) & (BP_TABLE_SIZE - 1);
+}
+
+/* Function to get the gshare entry, the PC XOR the global history
+ *
+ */
+static int
+get_gshare_index(int pc, unsigned long long history)
+{
+	unsigned long long mask = BP_HISTORY_BITS < 64 ? (1ULL << BP_HISTORY_BITS) - 1 : ~0ULL;
+
+	return (((pc - PC_START) / INSTRUCTION_SIZE) ^ (int)(history & mask)) & (BP_TABLE_SIZE - 1);
+}
+
+/* Function to fold the newest length bits of the global history
+ * into bits wide chunks XORed together
+ *
+ */
+static unsigned int
+fold_history(unsigned long long history, int length, int bits)
+{
+	unsigned int folded = 0;
+
+	if(length < 64)
+	{
+		history &= (1ULL << length) - 1;
+	}
+	while(history)
+	{
+		folded ^= history & ((1u << bits) - 1);
+		history >>= bits;
+	}
+	return folded;
+}
+
+/* Function to get the entry of a TAGE tagged table
+ *
+ */
+static TAGE_Entry *
+get_tage_entry(APEX_CPU *cpu, int t, int pc, unsigned long long history)
+{
+	int index_bits = 0;
+	unsigned int pc_bits = (pc - PC_START) / INSTRUCTION_SIZE;
+	unsigned int index;
+
+	while((1 << index_bits) < TAGE_TABLE_SIZE)
+	{
+		index_bits++;
+	}
+	index = pc_bits ^ (pc_bits >> index_bits) ^ fold_history(history, cpu->bpred.tage_history_length[t], index_bits);
+	return &cpu->bpred.tage[t][index & (TAGE_TABLE_SIZE - 1)];
+}
+
+/* Function to get the tag of a branch in a TAGE tagged table, two
+ * foldings of different width keep branches with the same index apart
+ *
+ */
+static int
+get_tage_tag(APEX_CPU *cpu, int t, int pc, unsigned long long history)
+{
+	unsigned int pc_bits = (pc - PC_START) / INSTRUCTION_SIZE;
+	int length = cpu->bpred.tage_history_length[t];
+
+	return (pc_bits ^ fold_history(history, length, TAGE_TAG_BITS) ^
+			(fold_history(history, length, TAGE_TAG_BITS - 1) << 1)) & ((1 << TAGE_TAG_BITS) - 1);
+}
+
+/* Function to predict with TAGE. The matching table with the longest
+ * history provides the prediction, the next one (or the base bimodal
+ * table) the alternate prediction. Provider is -1 for the base table
+ *
+ */
+static int
+tage_predict(APEX_CPU *cpu, int pc, unsigned long long history, int *provider, int *alt_taken)
+{
+	int taken = cpu->bpred.bimodal[get_bimodal_index(pc)] >= 2;
+
+	*provider = -1;
+	*alt_taken = taken;
+	for(int t = 0; t < TAGE_NUM_TABLES; t++)
+	{
+		TAGE_Entry *entry = get_tage_entry(cpu, t, pc, history);
+		if(entry->tag == get_tage_tag(cpu, t, pc, history))
+		{
+			*alt_taken = taken;
+			*provider = t;
+			taken = entry->counter >= 4;
+		}
+	}
+	return taken;
+}
+
+/* Function to train TAGE. The provider learns the outcome and becomes
+ * useful when it beat the alternate prediction. A misprediction takes
+ * an entry in a table with a longer history, or ages the entries in
+ * the way when none is free
+ *
+ */
+static void
+tage_update(APEX_CPU *cpu, int pc, unsigned long long history, int taken)
+{
+	int provider, alt_taken;
+	int predicted = tage_predict(cpu, pc, history, &provider, &alt_taken);
+
+	if(provider >= 0)
+	{
+		TAGE_Entry *entry = get_tage_entry(cpu, provider, pc, history);
+		if(predicted != alt_taken)
+		{
+			if(predicted == taken && entry->useful < 3)
+			{
+				entry->useful++;
+			}
+			else if(predicted != taken && entry->useful > 0)
+			{
+				entry->useful--;
+			}
+		}
+		if(taken && entry->counter < 7)
+		{
+			entry->counter++;
+		}
+		else if(!taken && entry->counter > 0)
+		{
+			entry->counter--;
+		}
+	}
+	else
+	{
+		update_2bit_counter(&cpu->bpred.bimodal[get_bimodal_index(pc)], taken);
+	}
+
+	if(predicted != taken)
+	{
+		int allocated = FALSE;
+		for(int t = provider + 1; t < TAGE_NUM_TABLES && !allocated; t++)
+		{
+			TAGE_Entry *entry = get_tage_entry(cpu, t, pc, history);
+			if(entry->useful == 0)
+			{
+				entry->tag = get_tage_tag(cpu, t, pc, history);
+				entry->counter = taken ? 4 : 3;
+				allocated = TRUE;
+			}
+		}
+		for(int t = provider + 1; t < TAGE_NUM_TABLES && !allocated; t++)
+		{
+			TAGE_Entry *entry = get_tage_entry(cpu, t, pc, history);
+			if(entry->useful > 0)
+			{
+				entry->useful--;
+			}
+		}
+	}
+
+	/* Entries that stopped being useful are freed now and then */
+	if(++cpu->bpred.tage_updates % TAGE_USEFUL_RESET_PERIOD == 0)
+	{
+		for(int t = 0; t < TAGE_NUM_TABLES; t++)
+		{
+			for(int i = 0; i < TAGE_TABLE_SIZE; i++)
+			{
+				cpu->bpred.tage[t][i].useful >>= 1;
+			}
+		}
+	}
+}
+
+/* Branch predictor interface, predicts the direction of the
+ * conditional branch at a PC from the global history before it
+ *
+ */
+static int
+predict_branch_direction(APEX_CPU *cpu, int pc, unsigned long long history)
+{
+	switch(cpu->bpred.type)
+	{
+		case BP_BIMODAL:
+		{
+			return cpu->bpred.bimodal[get_bimodal_index(pc)] >= 2;
+		}
+
+		case BP_GSHARE:
+		{
+			return cpu->bpred.gshare[get_gshare_index(pc, history)] >= 2;
+		}
+
+		case BP_TOURNAMENT:
+		{
+			if(cpu->bpred.chooser[get_bimodal_index(pc)] >= 2)
+			{
+				return cpu->bpred.gshare[get_gshare_index(pc, history)] >= 2;
+			}
+			return cpu->bpred.bimodal[get_bimodal_index(pc)] >= 2;
+		}
+
+		case BP_TAGE:
+		{
+			int provider, alt_taken;
+			return tage_predict(cpu, pc, history, &provider, &alt_taken);
+		}
+	}
+	return FALSE;
+}
+
+/* Branch predictor interface, trains the configured predictor with
+ * the outcome of a resolved conditional branch
+ *
+ */
+static void
+train_branch_predictor(APEX_CPU *cpu, int pc, unsigned long long history, int taken)
+{
+	switch(cpu->bpred.type)
+	{
+		case BP_BIMODAL:
+		{
+			update_2bit_counter(&cpu->bpred.bimodal[get_bimodal_index(pc)], taken);
+			break;
+		}
+
+		case BP_GSHARE:
+		{
+			update_2bit_counter(&cpu->bpred.gshare[get_gshare_index(pc, history)], taken);
+			break;
+		}
+
+		case BP_TOURNAMENT:
+		{
+			int bimodal_taken = cpu->bpred.bimodal[get_bimodal_index(pc)] >= 2;
+			int gshare_taken = cpu->bpred.gshare[get_gshare_index(pc, history)] >= 2;
+
+			/* The chooser only learns when the components disagree */
+			if(bimodal_taken != gshare_taken)
+			{
+				update_2bit_counter(&cpu->bpred.chooser[get_bimodal_index(pc)], gshare_taken == taken);
+			}
+			update_2bit_counter(&cpu->bpred.bimodal[get_bimodal_index(pc)], taken);
+			update_2bit_counter(&cpu->bpred.gshare[get_gshare_index(pc, history)], taken);
+			break;
+		}
+
+		case BP_TAGE:
+		{
+			tage_update(cpu, pc, history, taken);
+			break;
+		}
+	}
+}
+
+/* Function to get the indirect predictor entry of a jump, the PC
+ * XOR the newest INDIRECT_HISTORY_BITS of global history
+ *
+ */
+static int
+get_indirect_index(int pc, unsigned long long history)
+{
+	unsigned long long mask = INDIRECT_HISTORY_BITS < 64 ? (1ULL << INDIRECT_HISTORY_BITS) - 1 : ~0ULL;
+
+	return (((pc - PC_START) / INSTRUCTION_SIZE) ^ (int)(history & mask)) & (INDIRECT_TABLE_SIZE - 1);
+}
+
+/* Function to predict the target of an indirect jump, returns -1
+ * when no entry is tagged with its PC
+ *
+ */
+static int
+predict_indirect_target(APEX_CPU *cpu, int pc, unsigned long long history)
+{
+	const INDIRECT_Entry *entry = &cpu->tpred.indirect[get_indirect_index(pc, history)];
+
+	if(entry->valid && entry->tag == pc)
+	{
+		return entry->target;
+	}
+	return -1;
+}
+
+/* Function to train the indirect predictor with the resolved target
+ * of a jump
+ *
+ */
+static void
+update_indirect_target(APEX_CPU *cpu, int pc, unsigned long long history, int target)
+{
+	INDIRECT_Entry *entry = &cpu->tpred.indirect[get_indirect_index(pc, history)];
+
+	entry->valid = TRUE;
+	entry->tag = pc;
+	entry->target = target;
+}
+
+/* Function to start the prediction of the instruction at a PC as
+ * not taken, with the global history and the return address stack
+ * before it as checkpoint
+ *
+ */
+static void
+init_prediction(APEX_CPU *cpu, int pc, BRANCH_PREDICTION *prediction)
+{
+	prediction->direction = FALSE;
+	prediction->taken = FALSE;
+	prediction->target = pc + INSTRUCTION_SIZE;
+	prediction->indirect_hit = FALSE;
+	prediction->history = cpu->bpred.history;
+	prediction->ras_top = cpu->tpred.ras.top;
+	prediction->ras_value = cpu->tpred.ras.entries[cpu->tpred.ras.top];
+}
+
+/* Function to predict the instruction at a PC for the branch
+ * prediction unit. Conditional branches ask the direction predictor,
+ * the other control transfers are always taken. RET takes its target
+ * from the return address stack, JUMP and JALR from the indirect
+ * predictor, everything else from the btb. The direction followed is
+ * shifted into the global history
+ *
+ */
+static void
+predict_next_pc(APEX_CPU *cpu, int pc, int opcode, BRANCH_PREDICTION *prediction)
+{
+	int target = -1;
+
+	init_prediction(cpu, pc, prediction);
+	if(!check_control_transfer(opcode))
+	{
+		return;
+	}
+
+	prediction->direction = TRUE;
+	if(check_conditional_branch(opcode))
+	{
+		prediction->direction = predict_branch_direction(cpu, pc, cpu->bpred.history);
+	}
+	if(opcode == OPCODE_RET && RETURN_ADDRESS_STACK)
+	{
+		target = ras_pop(&cpu->tpred.ras);
+	}
+	else if(prediction->direction)
+	{
+		if(check_indirect_jump(opcode) && INDIRECT_PREDICTOR)
+		{
+			target = predict_indirect_target(cpu, pc, cpu->bpred.history);
+			prediction->indirect_hit = target >= 0;
+		}
+		if(target < 0)
+		{
+			target = predict_btb_target(cpu, pc);
+			if(target >= 0)
+			{
+				printf("BTB Hit\n");
+			}
+		}
+	}
+	if(opcode == OPCODE_JALR && RETURN_ADDRESS_STACK)
+	{
+		ras_push(&cpu->tpred.ras, pc + INSTRUCTION_SIZE);
+	}
+
+	/* An empty or overwritten stack entry may point anywhere, only a
+	 * target inside the code is followed */
+	if(prediction->direction && target >= PC_START &&
+	   get_code_memory_index_from_pc(target) < cpu->code_memory_size)
+	{
+		prediction->taken = TRUE;
+		prediction->target = target;
+	}
+	if(check_conditional_branch(opcode))
+	{
+		cpu->bpred.history = (cpu->bpred.history << 1) | prediction->taken;
+	}
+}
+
+/* Function to predict a conditional branch whose taken target is
+ * already known, no btb lookup is needed
+ *
+ */
+static void
+predict_branch_known_target(APEX_CPU *cpu, int pc, int target, BRANCH_PREDICTION *prediction)
+{
+	init_prediction(cpu, pc, prediction);
+	prediction->direction = predict_branch_direction(cpu, pc, cpu->bpred.history);
+	prediction->taken = prediction->direction;
+	if(prediction->taken)
+	{
+		prediction->target = target;
+	}
+	cpu->bpred.history = (cpu->bpred.history << 1) | prediction->taken;
+}
+
+/* Function to get the first way of the trace cache set of a start PC
+ *
+ */
+static TRACE_Line *
+get_trace_set(APEX_CPU *cpu, int pc)
+{
+	return cpu->trace_cache.lines[((pc - PC_START) / INSTRUCTION_SIZE) & (TRACE_CACHE_SETS - 1)];
+}
+
+/* Function to check if the direction predictor follows the path of a
+ * trace, every branch before its last instruction has to be predicted
+ * the way it went when the trace was built
+ *
+ */
+static int
+check_trace_path(APEX_CPU *cpu, const TRACE_Line *line)
+{
+	unsigned long long history = cpu->bpred.history;
+
+	for(int i = 0; i < line->count - 1; i++)
+	{
+		if(check_conditional_branch(line->opcodes[i]))
+		{
+			int taken = line->pcs[i + 1] != line->pcs[i] + INSTRUCTION_SIZE;
+
+			if(predict_branch_direction(cpu, line->pcs[i], history) != taken)
+			{
+				return FALSE;
+			}
+			history = (history << 1) | taken;
+		}
+	}
+	return TRUE;
+}
+
+/* Function to predict a fetch block from the trace cache, returns
+ * FALSE when no trace starting at the PC follows the predicted path.
+ * The branches inside the trace take their targets from it, the last
+ * instruction is predicted like in any other block
+ *
+ */
+static int
+predict_trace_block(APEX_CPU *cpu, FTQ_Entry *block)
+{
+	TRACE_Line *set = get_trace_set(cpu, cpu->pc);
+	TRACE_Line *line = NULL;
+	int last;
+
+	cpu->trace_cache.lookups++;
+	for(int i = 0; i < TRACE_CACHE_WAYS && !line; i++)
+	{
+		if(set[i].valid && set[i].pcs[0] == cpu->pc && check_trace_path(cpu, &set[i]))
+		{
+			line = &set[i];
+		}
+	}
+	if(!line)
+	{
+		return FALSE;
+	}
+
+	cpu->trace_cache.hits++;
+	cpu->trace_cache.instructions += line->count;
+	line->lru = cpu->clock;
+	last = line->count - 1;
+	for(int i = 0; i < last; i++)
+	{
+		block->pcs[i] = line->pcs[i];
+		if(check_conditional_branch(line->opcodes[i]))
+		{
+			predict_branch_known_target(cpu, line->pcs[i], line->pcs[i + 1], &block->predictions[i]);
+		}
+		else
+		{
+			init_prediction(cpu, line->pcs[i], &block->predictions[i]);
+		}
+	}
+	block->pcs[last] = line->pcs[last];
+	predict_next_pc(cpu, line->pcs[last], line->opcodes[last], &block->predictions[last]);
+	block->count = line->count;
+	cpu->pc = block->predictions[last].target;
+	if(line->opcodes[last] == OPCODE_HALT)
+	{
+		cpu->fetch_halted = TRUE;
+	}
+	return TRUE;
+}
+
+/* Function to put a trace built at decode in the trace cache. Only
+ * traces crossing a taken branch are kept, a trace already held is
+ * refreshed and a new one replaces the least recently used way
+ *
+ */
+static void
+insert_trace(APEX_CPU *cpu, const TRACE_Line *trace)
+{
+	TRACE_Line *set = get_trace_set(cpu, trace->pcs[0]);
+	TRACE_Line *way = &set[0];
+	int crosses = FALSE;
+
+	for(int i = 0; i < trace->count - 1; i++)
+	{
+		crosses |= trace->pcs[i + 1] != trace->pcs[i] + INSTRUCTION_SIZE;
+	}
+	if(!crosses)
+	{
+		return;
+	}
+
+	for(int i = 0; i < TRACE_CACHE_WAYS; i++)
+	{
+		if(set[i].valid && set[i].count == trace->count &&
+		   !memcmp(set[i].pcs, trace->pcs, trace->count * sizeof(int)))
+		{
+			set[i].lru = cpu->clock;
+			return;
+		}
+		if(way->valid && (!set[i].valid || set[i].lru < way->lru))
+		{
+			way = &set[i];
+		}
+	}
+	*way = *trace;
+	way->valid = TRUE;
+	way->lru = cpu->clock;
+	cpu->trace_cache.built++;
+}
+
+/* Fill unit of the trace cache, follows the instructions entering
+ * decode from the fetch buffer. A trace ends after FRONTEND_WIDTH
+ * instructions, TRACE_MAX_BRANCHES conditional branches or another
+ * control transfer or HALT
+ *
+ */
+static void
+fill_trace(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+	TRACE_CACHE_UNIT *trace_cache = &cpu->trace_cache;
+	TRACE_Line *fill = &trace_cache->fill;
+
+	/* A flush or a replayed loop breaks the path, start over */
+	if(fill->count > 0 && stage->pc != trace_cache->fill_next_pc)
+	{
+		fill->count = 0;
+	}
+	if(fill->count == 0)
+	{
+		trace_cache->fill_branches = 0;
+	}
+	fill->pcs[fill->count] = stage->pc;
+	fill->opcodes[fill->count++] = stage->opcode;
+	trace_cache->fill_next_pc = stage->prediction.target;
+	if(check_conditional_branch(stage->opcode))
+	{
+		trace_cache->fill_branches++;
+	}
+	if(fill->count == FRONTEND_WIDTH || trace_cache->fill_branches == TRACE_MAX_BRANCHES ||
+	   (check_control_transfer(stage->opcode) && !check_conditional_branch(stage->opcode)) ||
+	   stage->opcode == OPCODE_HALT)
+	{
+		insert_trace(cpu, fill);
+		fill->count = 0;
+	}
+}
+
+/* Branch prediction unit, predicts the fetch block starting at the PC
+ * into the fetch target queue and moves the PC to the next block. The
+ * opcodes are predecoded from code memory, a block ends after a control
+ * transfer predicted taken or a HALT. A trace cache hit predicts a
+ * trace instead
+ *
+ */
+static void
+predict_fetch_block(APEX_CPU *cpu)
+{
+	FTQ_Entry *block;
+
+	/* A wrong path branch resolved ahead of an older one may
+	 * redirect anywhere, fetch waits for the older one's flush */
+	if(cpu->fetch_halted || cpu->loop_buffer.state == LOOP_ACTIVE || cpu->clock < cpu->ftq.resume_cycle ||
+	   cpu->pc < PC_START || get_code_memory_index_from_pc(cpu->pc) >= cpu->code_memory_size)
+	{
+		return;
+	}
+	if(cpu->ftq.size == FTQ_SIZE)
+	{
+		cpu->front_end.ftq_full_cycles++;
+		return;
+	}
+
+	block = &cpu->ftq.entries[(cpu->ftq.head + cpu->ftq.size) % FTQ_SIZE];
+	block->count = 0;
+	block->fetched = 0;
+	block->ready_cycle = cpu->clock + BPU_LATENCY;
+	block->trace = TRACE_CACHE && predict_trace_block(cpu, block);
+	while(!block->trace && block->count < FETCH_BLOCK_SIZE && get_code_memory_index_from_pc(cpu->pc) < cpu->code_memory_size)
+	{
+		BRANCH_PREDICTION *prediction = &block->predictions[block->count];
+		int opcode = cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)].opcode;
+
+		block->pcs[block->count++] = cpu->pc;
+		predict_next_pc(cpu, cpu->pc, opcode, prediction);
+		cpu->pc = prediction->target;
+		if(opcode == OPCODE_HALT)
+		{
+			cpu->fetch_halted = TRUE;
+			break;
+		}
+		if(prediction->taken)
+		{
+			break;
+		}
+	}
+	cpu->ftq.size++;
+	cpu->front_end.blocks++;
+	cpu->front_end.block_instructions += block->count;
+}
+
+/* Function to fetch the instruction at a PC of a fetch block into a
+ * front end slot together with the prediction made for it
+ *
+ */
+static void
+fetch_instruction(APEX_CPU *cpu, CPU_Stage *stage, int pc, const BRANCH_PREDICTION *prediction)
+{
+    APEX_Instruction *current_ins;
+
+    /* Store current PC in fetch latch */
+    stage->pc = pc;
+    stage->has_insn = TRUE;
+    stage->renamed = FALSE;
+
+    /* Index into code memory using this pc and copy all instruction fields
+    * into fetch latch  */
+    current_ins = &cpu->code_memory[get_code_memory_index_from_pc(pc)];
+    strcpy(stage->opcode_str, current_ins->opcode_str);
+    stage->opcode = current_ins->opcode;
+    stage->rd = current_ins->rd;
+    stage->rs1 = current_ins->rs1;
+    stage->rs2 = current_ins->rs2;
+    stage->imm = current_ins->imm;
+    stage->prediction = *prediction;
+    printf("Fetch at address = %d\n", pc);
+}
+
+/* Function to fetch up to FRONTEND_WIDTH instructions of the fetch
+ * blocks at the head of the FTQ into the fetch latch. The group ends
+ * after a control transfer predicted taken outside a trace or when the
+ * fetch buffer has no room for more
+ *
+ */
+static void
+fetch_group(APEX_CPU *cpu)
+{
+	int w = 0;
+
+	while(w < FRONTEND_WIDTH && cpu->ftq.size > 0)
+	{
+		FTQ_Entry *block = &cpu->ftq.entries[cpu->ftq.head];
+		int taken;
+
+		if(block->ready_cycle > cpu->clock)
+		{
+			break;
+		}
+		if(cpu->fetch_buffer.size + w == FETCH_BUFFER_SIZE)
+		{
+			cpu->front_end.buffer_full_cycles++;
+			break;
+		}
+		fetch_instruction(cpu, &cpu->fetch[w], block->pcs[block->fetched], &block->predictions[block->fetched]);
+		cpu->front_end.fetched++;
+		/* The taken branches inside a trace do not end the group */
+		taken = block->predictions[block->fetched].taken && (!block->trace || block->fetched == block->count - 1);
+		w++;
+		if(++block->fetched == block->count)
+		{
+			cpu->ftq.head = (cpu->ftq.head + 1) % FTQ_SIZE;
+			cpu->ftq.size--;
+		}
+		if(taken)
+		{
+			break;
+		}
+	}
+}
+
+/* Function to follow the instructions entering decode from the
+ * fetch buffer. A backward conditional branch predicted taken over at
+ * most LOOP_BUFFER_SIZE instructions starts a capture of the next
+ * iteration, which is replayed once it reaches the same branch predicted
+ * taken again. Anything else inside the loop abandons the capture
+ *
+ */
+static void
+capture_loop_instruction(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+	LOOP_STREAM_BUFFER *loop = &cpu->loop_buffer;
+
+	if(loop->state == LOOP_CAPTURING)
+	{
+		if(stage->pc != loop->start + loop->size * INSTRUCTION_SIZE || stage->opcode == OPCODE_HALT ||
+		   (check_control_transfer(stage->opcode) && stage->pc != loop->branch_pc))
+		{
+			loop->state = LOOP_IDLE;
+		}
+		else
+		{
+			loop->body[loop->size++] = *stage;
+			if(stage->pc == loop->branch_pc)
+			{
+				loop->state = LOOP_IDLE;
+				if(stage->prediction.taken)
+				{
+					/* What was fetched past the branch is replayed instead */
+					restore_fetch_queue_state(cpu);
+					squash_fetch_queues(cpu);
+					cpu->fetch_halted = FALSE;
+					loop->state = LOOP_ACTIVE;
+					loop->next = 0;
+					loop->loops++;
+				}
+			}
+			return;
+		}
+	}
+	if(loop->state == LOOP_IDLE && check_conditional_branch(stage->opcode) && stage->prediction.taken &&
+	   stage->prediction.target <= stage->pc &&
+	   (stage->pc - stage->prediction.target) / INSTRUCTION_SIZE < LOOP_BUFFER_SIZE)
+	{
+		loop->state = LOOP_CAPTURING;
+		loop->start = stage->prediction.target;
+		loop->branch_pc = stage->pc;
+		loop->size = 0;
+	}
+}
+
+/* Function to replay the next loop buffer instruction into a decode
+ * slot. The closing branch asks the direction predictor but needs no
+ * btb, a not taken prediction leaves the loop and restarts prediction
+ * after it. Returns TRUE after the branch, which ends the group
+ *
+ */
+static int
+replay_loop_instruction(APEX_CPU *cpu, CPU_Stage *stage)
+{
+	LOOP_STREAM_BUFFER *loop = &cpu->loop_buffer;
+
+	*stage = loop->body[loop->next];
+	init_prediction(cpu, stage->pc, &stage->prediction);
+	loop->replayed++;
+	if(stage->pc != loop->branch_pc)
+	{
+		loop->next++;
+		return FALSE;
+	}
+
+	predict_branch_known_target(cpu, stage->pc, loop->start, &stage->prediction);
+	loop->next = 0;
+	if(!stage->prediction.taken)
+	{
+		loop->state = LOOP_IDLE;
+		loop->exits++;
+		cpu->pc = stage->pc + INSTRUCTION_SIZE;
+	}
+	return TRUE;
+}
+
+/*
+ * Fetch Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_fetch(APEX_CPU *cpu)
+{
+	/* Prediction runs ahead of fetch until the FTQ is full, a block
+	 * predicted with BPU_LATENCY 0 is fetched in the same cycle */
+	predict_fetch_block(cpu);
+	squash_front_end_group(cpu, cpu->fetch, 0);
+	fetch_group(cpu);
+
+	/* Copy data from fetch latch to debug fetch latch*/
+	memcpy(cpu->debug_fetch, cpu->fetch, sizeof(cpu->fetch));
+
+	for(int w = 0; w < FRONTEND_WIDTH && cpu->fetch[w].has_insn; w++)
+	{
+		cpu->fetch_buffer.entries[(cpu->fetch_buffer.head + cpu->fetch_buffer.size) % FETCH_BUFFER_SIZE] = cpu->fetch[w];
+		cpu->fetch_buffer.size++;
+	}
+
+	/* Decode takes the oldest instructions of the fetch buffer, or the
+	 * loop buffer while it replays, once its whole group has moved on */
+	if(!cpu->stall)
+	{
+		squash_front_end_group(cpu, cpu->decode_rename1, 0);
+		for(int w = 0; w < FRONTEND_WIDTH; w++)
+		{
+			if(cpu->loop_buffer.state == LOOP_ACTIVE)
+			{
+				cpu->loop_buffer.delivered++;
+				if(replay_loop_instruction(cpu, &cpu->decode_rename1[w]))
+				{
+					break;
+				}
+			}
+			else if(cpu->fetch_buffer.size > 0)
+			{
+				cpu->decode_rename1[w] = cpu->fetch_buffer.entries[cpu->fetch_buffer.head];
+				cpu->fetch_buffer.head = (cpu->fetch_buffer.head + 1) % FETCH_BUFFER_SIZE;
+				cpu->fetch_buffer.size--;
+				cpu->loop_buffer.delivered++;
+				if(TRACE_CACHE)
+				{
+					fill_trace(cpu, &cpu->decode_rename1[w]);
+				}
+				if(LOOP_BUFFER)
+				{
+					capture_loop_instruction(cpu, &cpu->decode_rename1[w]);
+				}
+			}
+			else
+			{
+				break;
+			}
+		}
+	}
+	cpu->front_end.ftq_occupancy += cpu->ftq.size;
+	cpu->front_end.buffer_occupancy += cpu->fetch_buffer.size;
+}
+
+/* Function to rename the destination of the instruction in a decode
+ * slot. Returns FALSE when it has to wait, which holds the slot and
+ * every younger one in decode
+ *
+ */
+static int
+rename_instruction(APEX_CPU *cpu, int slot)
+{
+	CPU_Stage *stage = &cpu->decode_rename1[slot];
+	int reg = -1;
+
+    /* Read operands from register file based on the instruction type */
+    switch (stage->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        {
+        	reg = get_free_physical_register(cpu);
+        	if(reg < 0)
+        	{
+        		return FALSE;
+        	}
+    		stage->p1 = cpu->rename_table[stage->rs1].slot_id;
+        	stage->p2 = cpu->rename_table[stage->rs2].slot_id;
+        	stage->pd = reg;
+        	allocate_physical_register(cpu, reg);
+            break;
+        }
+
+		case OPCODE_CMP:
+        {
+        	reg = get_free_hidden_physical_register(cpu);
+        	if(reg < 0)
+        	{
+        		return FALSE;
+        	}
+    		stage->p1 = cpu->rename_table[stage->rs1].slot_id;
+        	stage->p2 = cpu->rename_table[stage->rs2].slot_id;
+        	stage->pd = reg;
+            break;
+        }
+
+		case OPCODE_STORE:
+        {
+        	stage->p1 = cpu->rename_table[stage->rs1].slot_id;
+        	stage->p2 = cpu->rename_table[stage->rs2].slot_id;
+            break;
+        }
+
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_LOAD:
+        {
+        	reg = get_free_physical_register(cpu);
+        	if(reg < 0)
+        	{
+        		return FALSE;
+        	}
+        	stage->p1 = cpu->rename_table[stage->rs1].slot_id;
+        	stage->pd = reg;
+        	allocate_physical_register(cpu, reg);
+            break;
+        }
+
+        case OPCODE_MOVC:
+        {
+        	reg = get_free_physical_register(cpu);
+        	if(reg < 0)
+        	{
+        		return FALSE;
+        	}
+        	stage->pd = reg;
+        	allocate_physical_register(cpu, reg);
+            break;
+        }
+
+        case OPCODE_JALR:
+        {
+        	reg = get_free_physical_register(cpu);
+        	if(reg < 0)
+        	{
+        		return FALSE;
+        	}
+        	stage->p1 = cpu->rename_table[stage->rs1].slot_id;
+        	stage->pd = reg;
+        	allocate_physical_register(cpu, reg);
+            break;
+        }
+
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_JUMP:
+        case OPCODE_RET:
+        {
+        	stage->p1 = cpu->rename_table[stage->rs1].slot_id;
+        	break;
+        }
+    }
+    return TRUE;
+}
+
+/* Function to compute the target of the conditional branches in
+ * decode. The first one predicted taken whose target missed in the btb
+ * now follows the prediction: the younger instructions are dropped,
+ * prediction restarts after the branch at its target and the target is
+ * put in the btb. A backward branch the btb has never seen is predicted
+ * taken here, the direction predictor knows nothing about it yet
+ *
+ */
+static void
+redirect_at_decode(APEX_CPU *cpu)
+{
+	for(int w = 0; w < FRONTEND_WIDTH && cpu->decode_rename1[w].has_insn; w++)
+	{
+		CPU_Stage *stage = &cpu->decode_rename1[w];
+		int target = stage->pc + stage->imm;
+
+		if(!check_conditional_branch(stage->opcode) || stage->prediction.taken ||
+		   target < PC_START || get_code_memory_index_from_pc(target) >= cpu->code_memory_size ||
+		   !(stage->prediction.direction || (target <= stage->pc && !cpu->btb.shadow.seen[get_code_memory_index_from_pc(stage->pc)])))
+		{
+			continue;
+		}
+
+		stage->prediction.direction = TRUE;
+		stage->prediction.taken = TRUE;
+		stage->prediction.target = target;
+		update_btb_entry(cpu, stage->pc, stage->opcode, target);
+		restore_fetch_queue_state(cpu);
+		for(int i = FRONTEND_WIDTH - 1; i >= w; i--)
+		{
+			if(cpu->decode_rename1[i].has_insn && check_control_transfer(cpu->decode_rename1[i].opcode))
+			{
+				restore_prediction_checkpoint(cpu, &cpu->decode_rename1[i].prediction);
+			}
+		}
+		cpu->bpred.history = (cpu->bpred.history << 1) | TRUE;
+		cpu->pc = target;
+		cpu->fetch_halted = FALSE;
+		squash_fetch_queues(cpu);
+		cpu->loop_buffer.state = LOOP_IDLE;
+		squash_front_end_group(cpu, cpu->decode_rename1, w + 1);
+		cpu->btb.decode_redirects++;
+		return;
+	}
+}
+
+/*
+ * Decode/Rename1 Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_decode_rename1(APEX_CPU *cpu)
+{
+	int n = 0;
+
+	if(DECODE_REDIRECT)
+	{
+		redirect_at_decode(cpu);
+	}
+	if(cpu->d_stall == 1)
+	{
+		cpu->stall = 1;
+        /* Copy data from decode latch to debug decode latch*/
+		memcpy(cpu->debug_decode_rename1, cpu->decode_rename1, sizeof(cpu->decode_rename1));
+        return;
+	}
+
+	/* Slots rename in program order, a slot that has to wait holds
+	 * back every younger slot of the group */
+	while(n < FRONTEND_WIDTH && cpu->decode_rename1[n].has_insn &&
+		  (cpu->decode_rename1[n].renamed || rename_instruction(cpu, n)))
+	{
+		cpu->decode_rename1[n].renamed = TRUE;
+		n++;
+	}
+
+    /* Copy data from decode latch to debug decode latch*/
+	memcpy(cpu->debug_decode_rename1, cpu->decode_rename1, sizeof(cpu->decode_rename1));
+
+	/* Renamed slots move to the dispatch latch, which is empty when
+	 * dispatch has not stalled, the rest move up in the group */
+	for(int w = 0; w < FRONTEND_WIDTH; w++)
+	{
+		if(w < n)
+		{
+			cpu->rename2_dispatch[w] = cpu->decode_rename1[w];
+		}
+		if(w + n < FRONTEND_WIDTH)
+		{
+			cpu->decode_rename1[w] = cpu->decode_rename1[w + n];
+		}
+		else
+		{
+			cpu->decode_rename1[w].has_insn = FALSE;
+			cpu->decode_rename1[w].renamed = FALSE;
+		}
+	}
+	cpu->stall = cpu->decode_rename1[0].has_insn;
+}
+
+/* Function to look up the rob entries producing the sources of a
+ * dispatching instruction. Older slots of the group have already
+ * written their destinations to the rename table, so a source
+ * produced inside the group maps to its producer
+ *
+ */
+static void
+rename_sources(APEX_CPU *cpu, CPU_Stage *stage)
+{
+	switch(stage->opcode)
+	{
+		case OPCODE_ADD:
+		case OPCODE_SUB:
+		case OPCODE_MUL:
+		case OPCODE_DIV:
+		case OPCODE_AND:
+		case OPCODE_OR:
+		case OPCODE_XOR:
+		case OPCODE_CMP:
+		case OPCODE_STORE:
+		{
+			stage->p1 = cpu->rename_table[stage->rs1].slot_id;
+			stage->p2 = cpu->rename_table[stage->rs2].slot_id;
+			break;
+		}
+
+		case OPCODE_ADDL:
+		case OPCODE_SUBL:
+		case OPCODE_LOAD:
+		case OPCODE_JALR:
+		case OPCODE_BZ:
+		case OPCODE_BNZ:
+		case OPCODE_BP:
+		case OPCODE_BNP:
+		case OPCODE_JUMP:
+		case OPCODE_RET:
+		{
+			stage->p1 = cpu->rename_table[stage->rs1].slot_id;
+			break;
+		}
+	}
+}
+
+/*
+ * Rename2/Dispatch Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_rename2_dispatch(APEX_CPU *cpu)
+{
+	int dispatched = 0;
+
+	cpu->d_stall = 0;
+	memcpy(cpu->debug_rename2_dispatch, cpu->rename2_dispatch, sizeof(cpu->rename2_dispatch));
+	while(dispatched < FRONTEND_WIDTH && cpu->rename2_dispatch[dispatched].has_insn)
+	{
+		CPU_Stage *stage = &cpu->rename2_dispatch[dispatched];
+		int checkpoint = FALSE;
+
+		rename_sources(cpu, stage);
+
+        /* Read operands from register file based on the instruction type */
+        switch (stage->opcode)
+        {
+            case OPCODE_ADD:
+            case OPCODE_SUB:
+            case OPCODE_MUL:
+            case OPCODE_DIV:
+            case OPCODE_AND:
+            case OPCODE_OR:
+            case OPCODE_XOR:
+            case OPCODE_CMP:
+            case OPCODE_ADDL:
+            case OPCODE_SUBL:
+            case OPCODE_MOVC:
+            case OPCODE_HALT:
+            case OPCODE_NOP:
+            {
+            	check_r_to_r_instruction_dependency(cpu, stage);
+                break;
+            }
+
+            case OPCODE_BP:
+            case OPCODE_BNP:
+            case OPCODE_BZ:
+            case OPCODE_BNZ:
+            case OPCODE_JALR:
+            case OPCODE_JUMP:
+            case OPCODE_RET:
+            {
+            	if(stage->opcode == OPCODE_BZ)
+            	{
+            		printf("BZ RD2 ROB ID = %d, for CCR = %d", stage->p1, stage->rs1);
+            	}
+            	check_r_to_r_instruction_dependency(cpu, stage);
+            	checkpoint = TRUE;
+            	break;
+            }
+
+            case OPCODE_STORE:
+            case OPCODE_LOAD:
+            {
+            	int lid = check_load_store_instruction_dependency(cpu, stage);
+            	if(lid >= 0 && cpu->lsq.entries[lid].value_predicted)
             	{
-            		cpu->stall = 1;
+            		/* Dependents of the predicted value are squashed
+            		 * when the prediction is wrong */
+            		checkpoint = TRUE;
             	}
                 break;
             }
+        }
+        /* Copy data from decode latch to debug decode latch*/
+        cpu->debug_rename2_dispatch[dispatched] = *stage;
+        if(cpu->d_stall == 1)
+        {
+        	break;
+        }
+    	/* A flush after this instruction restores the rename table
+    	 * as it is right after its dispatch */
+    	if(checkpoint)
+    	{
+    		memcpy(cpu->rb.entries[cpu->rb.rear].rename_checkpoint, cpu->rename_table, sizeof(RENAME_TABLE) * REG_FILE_SIZE);
+    	}
+        stage->has_insn = FALSE;
+        dispatched++;
+	}
+
+	if(dispatched > 0)
+	{
+		cpu->front_end.dispatched += dispatched;
+		cpu->front_end.dispatch_cycles++;
+		if(dispatched == FRONTEND_WIDTH)
+		{
+			cpu->front_end.full_dispatch_cycles++;
+		}
+	}
+
+	/* Slots left behind move up, decode waits until all have gone */
+	for(int w = 0; w < FRONTEND_WIDTH; w++)
+	{
+		if(w + dispatched < FRONTEND_WIDTH)
+		{
+			cpu->rename2_dispatch[w] = cpu->rename2_dispatch[w + dispatched];
+		}
+		else
+		{
+			cpu->rename2_dispatch[w].has_insn = FALSE;
+		}
+	}
+	cpu->d_stall = cpu->rename2_dispatch[0].has_insn;
+}
+
+/* Function to check if a unit of the functional unit pool has
+ * already selected an IQ entry that has not started yet
+ *
+ */
+static int
+check_iq_entry_selected(APEX_CPU *cpu, int id)
+{
+	for(int u = 0; u < NUM_FUS; u++)
+	{
+		for(int k = 0; k < cpu->fu_pool[u].slots; k++)
+		{
+			if(cpu->execute_fu[u][k].has_insn && cpu->execute_fu[u][k].iq_id == id &&
+			   cpu->execute_fu[u][k].delay == cpu->fu_pool[u].latency)
+			{
+				return TRUE;
+			}
+		}
+	}
+	return FALSE;
+}
+
+/* Function to get the age of a rob entry in program order,
+ * the rob head is 0
+ *
+ */
+static int
+get_rob_age(const APEX_CPU *cpu, int rob_id)
+{
+	return (rob_id - cpu->rb.front + ROB_SIZE) % ROB_SIZE;
+}
+
+/*
+ * Function to get the next available instruction for a unit of
+ * the functional unit pool, the oldest ready one it can execute
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+get_next_available_fu_instruction(APEX_CPU *cpu, int u)
+{
+	int id = -1;
+	int min = ROB_SIZE;
+	for(int i = 0; i < IQ_SIZE; i++)
+	{
+		if(cpu->iq.entries[i].al == ALLOCATED &&
+		   (cpu->fu_pool[u].opcodes & FU_OPCODE(cpu->iq.entries[i].fu_type)) &&
+		   cpu->iq.entries[i].src1_ready == VALID &&
+		   cpu->iq.entries[i].src2_ready == VALID &&
+		   !check_iq_entry_selected(cpu, i))
+		{
+			if(get_rob_age(cpu, cpu->iq.entries[i].rob_id) < min)
+			{
+				id = i;
+				min = get_rob_age(cpu, cpu->iq.entries[i].rob_id);
+			}
+		}
+	}
+	return id;
+}
+
+/*
+ * Function to get the next available LOAD/STORE for an AGU, only the
+ * base register is needed when stores are split into STA and STD
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+get_next_available_agu_instruction(APEX_CPU *cpu)
+{
+	int id = -1;
+	int min = ROB_SIZE;
+	for(int i = 0; i < IQ_SIZE; i++)
+	{
+		if(cpu->iq.entries[i].al == ALLOCATED &&
+		  ((cpu->iq.entries[i].fu_type == OPCODE_LOAD && cpu->iq.entries[i].src1_ready == VALID) ||
+		   (cpu->iq.entries[i].fu_type == OPCODE_STORE && cpu->iq.entries[i].src2_ready == VALID &&
+		   (STORE_SPLIT_STA_STD || cpu->iq.entries[i].src1_ready == VALID))))
+		{
+			if(get_rob_age(cpu, cpu->iq.entries[i].rob_id) < min)
+			{
+				id = i;
+				min = get_rob_age(cpu, cpu->iq.entries[i].rob_id);
+			}
+		}
+	}
+	return id;
+}
+
+/* Function to check a load against the older stores still in the
+ * LSQ. The youngest older store to the same address forwards its
+ * data once it is ready, accesses are whole words so a match is
+ * always a full overlap. A store with an unknown address younger
+ * than that blocks the load, unless LOAD_SPECULATION assumes it
+ * does not match and marks the load speculative
+ *
+ */
+static int
+check_load_disambiguation(APEX_CPU *cpu, int lid)
+{
+	int unknown = FALSE;
+	int store = -1;
+	for(int i = cpu->lsq.front; i != lid; i = (i + 1) % LSQ_SIZE)
+	{
+		if(cpu->lsq.entries[i].ls_bit == 0)
+		{
+			continue;
+		}
+		if(cpu->lsq.entries[i].mem_valid != VALID)
+		{
+			unknown = TRUE;
+		}
+		else if(cpu->lsq.entries[i].mem_address == cpu->lsq.entries[lid].mem_address)
+		{
+			store = i;
+			unknown = FALSE;
+		}
+	}
+	if((unknown && !LOAD_SPECULATION) || (store >= 0 && cpu->lsq.entries[store].data_ready != VALID))
+	{
+		return FALSE;
+	}
+	cpu->lsq.entries[lid].speculative = unknown;
+	cpu->lsq.entries[lid].forwarded = (store >= 0);
+	cpu->lsq.entries[lid].sb_forwarded = FALSE;
+	if(store >= 0)
+	{
+		cpu->lsq.entries[lid].src1_value = cpu->lsq.entries[store].src1_value;
+		cpu->lsq.entries[lid].poisoned |= cpu->lsq.entries[store].poisoned ||
+				check_source_poisoned(cpu, cpu->lsq.entries[store].src1_src, cpu->lsq.entries[store].src1_tag);
+	}
+	else if(store_buffer_forward(cpu, cpu->lsq.entries[lid].mem_address, &cpu->lsq.entries[lid].src1_value))
+	{
+		cpu->lsq.entries[lid].forwarded = TRUE;
+		cpu->lsq.entries[lid].sb_forwarded = TRUE;
+	}
+	return TRUE;
+}
+
+/* Function to check if a selected load needs a data cache bank
+ * that an access issued earlier this cycle already holds, stores
+ * only use a bank when they drain from the store buffer
+ *
+ */
+static int
+check_bank_conflict(APEX_CPU *cpu, int lid, unsigned int banks_busy)
+{
+	if(cpu->lsq.entries[lid].ls_bit == 1 || cpu->lsq.entries[lid].forwarded || cpu->lsq.entries[lid].poisoned ||
+	   cpu->lsq.entries[lid].bad_address)
+	{
+		return FALSE;
+	}
+	if(banks_busy & (1u << (cpu->lsq.entries[lid].mem_address % DCACHE_BANKS)))
+	{
+		cpu->dcache.bank_conflicts++;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/*
+ * Function to get the next available Load Store instruction for a
+ * load or a store pipe
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+get_next_available_load_store_instruction(APEX_CPU *cpu, LOAD_STORE_BIT kind, unsigned int banks_busy)
+{
+	int id = -1;
+	int older_pending = FALSE;
+	for(int n = 0, i = cpu->lsq.front; n < cpu->lsq.size && id < 0; n++, i = (i + 1) % LSQ_SIZE)
+	{
+		if(cpu->lsq.entries[i].al != ALLOCATED || cpu->lsq.entries[i].issued)
+		{
+			continue;
+		}
+		if(cpu->lsq.entries[i].ls_bit != kind)
+		{
+			/* Other kind of pipe picks it up */
+		}
+		else if(cpu->lsq.entries[i].ls_bit == 1)
+		{
+			/* Stores write memory in program order */
+			if(!older_pending && cpu->lsq.entries[i].mem_valid == VALID && cpu->lsq.entries[i].data_ready == VALID &&
+			   !check_bank_conflict(cpu, i, banks_busy))
+			{
+				id = i;
+			}
+		}
+		else if(check_store_set_dependency(cpu, i))
+		{
+			/* Predicted to read what an older store will write */
+			cpu->lsq.entries[i].ss_waited = TRUE;
+		}
+		else if(cpu->lsq.entries[i].mem_valid == VALID && check_load_disambiguation(cpu, i) &&
+				!check_bank_conflict(cpu, i, banks_busy))
+		{
+			id = i;
+		}
+		older_pending = TRUE;
+	}
+	return id;
+}
+
+/* Function to check if a branch unit has already taken an IQ
+ * entry, it leaves the IQ when the branch resolves
+ *
+ */
+static int
+check_iq_entry_in_bu(APEX_CPU *cpu, int id)
+{
+	for(int b = 0; b < NUM_BU_UNITS; b++)
+	{
+		if(cpu->execute_bu[b].has_insn && cpu->execute_bu[b].iq_id == id)
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/*
+ * Function to get the next available BU instruction
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+get_next_available_bu_instruction(APEX_CPU *cpu)
+{
+	int id = -1;
+	int min = ROB_SIZE;
+	for(int i = 0; i < IQ_SIZE; i++)
+	{
+		if(cpu->iq.entries[i].al == ALLOCATED &&
+		  (cpu->iq.entries[i].fu_type == OPCODE_BZ   ||
+		   cpu->iq.entries[i].fu_type == OPCODE_BNZ  ||
+		   cpu->iq.entries[i].fu_type == OPCODE_BP   ||
+		   cpu->iq.entries[i].fu_type == OPCODE_BNP  ||
+		   cpu->iq.entries[i].fu_type == OPCODE_JUMP ||
+		   cpu->iq.entries[i].fu_type == OPCODE_JALR ||
+		   cpu->iq.entries[i].fu_type == OPCODE_RET) &&
+		   cpu->iq.entries[i].src1_ready == VALID &&
+		   !check_iq_entry_in_bu(cpu, i))
+		{
+			if(get_rob_age(cpu, cpu->iq.entries[i].rob_id) < min)
+			{
+				id = i;
+				min = get_rob_age(cpu, cpu->iq.entries[i].rob_id);
+			}
+		}
+	}
+	return id;
+}
+
+/* Function to look up a line in the data cache, returns the
+ * way holding the line or -1 on a miss
+ *
+ */
+static int
+dcache_lookup(APEX_CPU *cpu, int line)
+{
+	int set = line % DCACHE_SETS;
+	for(int i = 0; i < DCACHE_WAYS; i++)
+	{
+		if(cpu->dcache.lines[set][i].valid && cpu->dcache.lines[set][i].tag == line)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Function to install a line in the data cache, replacing the
+ * least recently used way of the set
+ *
+ */
+static DCACHE_Line *
+dcache_fill(APEX_CPU *cpu, int line, unsigned int ready_cycle, int prefetched)
+{
+	int set = line % DCACHE_SETS;
+	int victim = 0;
+	for(int i = 0; i < DCACHE_WAYS; i++)
+	{
+		if(!cpu->dcache.lines[set][i].valid)
+		{
+			victim = i;
+			break;
+		}
+		if(cpu->dcache.lines[set][i].lru < cpu->dcache.lines[set][victim].lru)
+		{
+			victim = i;
+		}
+	}
+	if(cpu->dcache.lines[set][victim].valid && cpu->dcache.lines[set][victim].prefetched)
+	{
+		/* Prefetched line evicted before any demand access */
+		cpu->prefetcher.useless++;
+	}
+	cpu->dcache.lines[set][victim].valid = TRUE;
+	cpu->dcache.lines[set][victim].tag = line;
+	cpu->dcache.lines[set][victim].prefetched = prefetched;
+	cpu->dcache.lines[set][victim].lru = cpu->clock;
+	cpu->dcache.lines[set][victim].ready_cycle = ready_cycle;
+	return &cpu->dcache.lines[set][victim];
+}
+
+/* Function to request a line from memory on behalf of the
+ * prefetcher
+ *
+ */
+static void
+issue_prefetch(APEX_CPU *cpu, int address)
+{
+	int line;
+	if(address < 0 || address >= DATA_MEMORY_SIZE)
+	{
+		return;
+	}
+	line = address / DCACHE_LINE_SIZE;
+	if(dcache_lookup(cpu, line) >= 0)
+	{
+		cpu->prefetcher.redundant++;
+		return;
+	}
+	dcache_fill(cpu, line, cpu->clock + DCACHE_MISS_LATENCY, TRUE);
+	cpu->prefetcher.issued++;
+}
+
+/* PC indexed stride prefetcher, prefetches degree strides ahead
+ * once the same stride has been seen repeatedly for a load/store
+ *
+ */
+static void
+stride_prefetcher_observe(APEX_CPU *cpu, int pc, int address)
+{
+	int step;
+	STRIDE_PF_Entry *entry = &cpu->prefetcher.stride_table[((pc - PC_START) / INSTRUCTION_SIZE) % STRIDE_TABLE_SIZE];
+
+	if(!entry->valid || entry->pc != pc)
+	{
+		entry->valid = TRUE;
+		entry->pc = pc;
+		entry->last_address = address;
+		entry->stride = 0;
+		entry->confidence = 0;
+		return;
+	}
+
+	if(address - entry->last_address == entry->stride && entry->stride != 0)
+	{
+		if(entry->confidence < STRIDE_CONFIDENCE_MAX)
+		{
+			entry->confidence++;
+		}
+	}
+	else
+	{
+		if(entry->confidence > 0)
+		{
+			entry->confidence--;
+		}
+		else
+		{
+			entry->stride = address - entry->last_address;
+		}
+	}
+	entry->last_address = address;
+
+	if(entry->confidence >= STRIDE_CONFIDENCE_THRESHOLD)
+	{
+		/* Strides smaller than a line would keep hitting the same line */
+		step = entry->stride;
+		if(step > 0 && step < DCACHE_LINE_SIZE)
+		{
+			step = DCACHE_LINE_SIZE;
+		}
+		else if(step < 0 && step > -DCACHE_LINE_SIZE)
+		{
+			step = -DCACHE_LINE_SIZE;
+		}
+		for(int i = 1; i <= cpu->prefetcher.degree; i++)
+		{
+			issue_prefetch(cpu, address + i * step);
+		}
+	}
+}
+
+/* Next-N-line stream prefetcher, triggered by a demand miss or
+ * by the first demand hit on a prefetched line
+ *
+ */
+static void
+stream_prefetcher_observe(APEX_CPU *cpu, int address, int trigger)
+{
+	int line = address / DCACHE_LINE_SIZE;
+	if(!trigger)
+	{
+		return;
+	}
+	for(int i = 1; i <= cpu->prefetcher.degree; i++)
+	{
+		issue_prefetch(cpu, (line + i) * DCACHE_LINE_SIZE);
+	}
+}
 
-			case OPCODE_CMP:
-            {
-            	reg = get_free_hidden_physical_register(cpu);
-            	if(reg >= 0)
-            	{
-            		cpu->decode_rename1.p1 = cpu->rename_table[cpu->decode_rename1.rs1].slot_id;
-                	cpu->decode_rename1.p2 = cpu->rename_table[cpu->decode_rename1.rs2].slot_id;
-                	cpu->decode_rename1.pd = reg;
-                	cpu->stall = 0;
-            	}
-            	else
-            	{
-            		cpu->stall = 1;
-            	}
-                break;
-            }
+/* Prefetcher interface, every demand access of the LSU is
+ * presented to the configured prefetcher
+ *
+ */
+static void
+prefetcher_observe(APEX_CPU *cpu, int pc, int address, int trigger)
+{
+	switch(cpu->prefetcher.type)
+	{
+		case PF_STRIDE:
+		{
+			stride_prefetcher_observe(cpu, pc, address);
+			break;
+		}
 
-			case OPCODE_STORE:
-            {
-            	cpu->decode_rename1.p1 = cpu->rename_table[cpu->decode_rename1.rs1].slot_id;
-            	cpu->decode_rename1.p2 = cpu->rename_table[cpu->decode_rename1.rs2].slot_id;
-            	cpu->stall = 0;
-                break;
-            }
+		case PF_STREAM:
+		{
+			stream_prefetcher_observe(cpu, address, trigger);
+			break;
+		}
 
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            case OPCODE_LOAD:
-            {
-            	reg = get_free_physical_register(cpu);
-            	if(reg >= 0)
-            	{
-                	cpu->decode_rename1.p1 = cpu->rename_table[cpu->decode_rename1.rs1].slot_id;
-                	cpu->decode_rename1.pd = reg;
-                	allocate_physical_register(cpu, reg);
-                	cpu->stall = 0;
-            	}
-            	else
-            	{
-            		cpu->stall = 1;
-            	}
-                break;
-            }
+		case PF_NONE:
+		{
+			break;
+		}
+	}
+}
 
-            case OPCODE_MOVC:
-            {
-            	reg = get_free_physical_register(cpu);
-            	if(reg >= 0)
-            	{
-                	cpu->decode_rename1.pd = reg;
-                	allocate_physical_register(cpu, reg);
-                	cpu->stall = 0;
-            	}
-            	else
-            	{
-            		cpu->stall = 1;
-            	}
-                break;
-            }
+/* Function to push a demand reference through the LRU stacks of
+ * every set count, recording the depth at which the line is found
+ *
+ */
+static void
+cache_sweep_access(APEX_CPU *cpu, int line)
+{
+	cpu->cache_sweep.accesses++;
+	for(int k = 0; k < SWEEP_SET_CONFIGS; k++)
+	{
+		int set = line % (1 << k);
+		int *stack = cpu->cache_sweep.stacks[k][set];
+		int *depth = &cpu->cache_sweep.depth[k][set];
+		int d = 0;
 
-            case OPCODE_JALR:
-            {
-            	reg = get_free_physical_register(cpu);
-            	if(reg >= 0)
-            	{
-                	cpu->decode_rename1.p1 = cpu->rename_table[cpu->decode_rename1.rs1].slot_id;
-                	cpu->decode_rename1.pd = reg;
-                	allocate_physical_register(cpu, reg);
-                	cpu->stall = 0;
-
-                	if(cpu->decode_rename1.btb_id < 0)
-                	{
-                		cpu->decode_rename1.btb_id = get_free_btb_entry(cpu);
-                	}
-            	}
-            	else
-            	{
-            		cpu->stall = 1;
-            	}
-                break;
-            }
+		while(d < *depth && stack[d] != line)
+		{
+			d++;
+		}
+		if(d < *depth)
+		{
+			cpu->cache_sweep.hits[k][d]++;
+		}
+		else if(*depth < SWEEP_MAX_WAYS)
+		{
+			(*depth)++;
+		}
+		else
+		{
+			/* Deeper than any evaluated cache, the last line drops off */
+			d = SWEEP_MAX_WAYS - 1;
+		}
+		memmove(&stack[1], &stack[0], d * sizeof(int));
+		stack[0] = line;
+	}
+}
 
-            case OPCODE_BZ:
-            case OPCODE_BNZ:
-            case OPCODE_BP:
-            case OPCODE_BNP:
-            {
-            	if(cpu->decode_rename1.btb_id < 0)
-            	{
-            		cpu->decode_rename1.btb_id = get_free_btb_entry(cpu);
-            	}
-            	cpu->decode_rename1.p1 = cpu->rename_table[cpu->decode_rename1.rs1].slot_id;
-            	break;
-            }
+/* Function to perform the data cache access of a load/store
+ * issued to the LSU, returns its latency in cycles
+ *
+ */
+static int
+dcache_access(APEX_CPU *cpu, int pc, int address)
+{
+	int line = address / DCACHE_LINE_SIZE;
+	int latency = DCACHE_HIT_LATENCY;
+	int trigger = FALSE;
+	int way;
+	DCACHE_Line *entry;
+
+	cpu->dcache.accesses++;
+	/* Only addresses inside data memory are sampled, anything else
+	 * would index the LRU stacks with a negative set */
+	if(CACHE_SWEEP && address >= 0 && address < DATA_MEMORY_SIZE)
+	{
+		cache_sweep_access(cpu, line);
+	}
+	way = dcache_lookup(cpu, line);
+	if(way >= 0)
+	{
+		cpu->dcache.hits++;
+		entry = &cpu->dcache.lines[line % DCACHE_SETS][way];
+		entry->lru = cpu->clock;
+		if(entry->prefetched)
+		{
+			entry->prefetched = FALSE;
+			cpu->prefetcher.useful++;
+			trigger = TRUE;
+			if(entry->ready_cycle > cpu->clock + DCACHE_HIT_LATENCY)
+			{
+				cpu->prefetcher.late++;
+			}
+		}
+		if(entry->ready_cycle > cpu->clock + DCACHE_HIT_LATENCY)
+		{
+			/* Line still in flight, wait for the rest of the fill */
+			latency = entry->ready_cycle - cpu->clock;
+		}
+	}
+	else
+	{
+		cpu->dcache.misses++;
+		dcache_fill(cpu, line, cpu->clock + DCACHE_MISS_LATENCY, FALSE);
+		latency = DCACHE_MISS_LATENCY;
+		trigger = TRUE;
+	}
+	prefetcher_observe(cpu, pc, address, trigger);
+	return latency;
+}
 
-            case OPCODE_JUMP:
-            {
-            	if(cpu->decode_rename1.btb_id < 0)
-            	{
-            		cpu->decode_rename1.btb_id = get_free_btb_entry(cpu);
-            	}
-            	cpu->decode_rename1.p1 = cpu->rename_table[cpu->decode_rename1.rs1].slot_id;
-            	cpu->stall = 0;
-                break;
-            }
+/* Function to check whether a line can be read by the LSU
+ * without waiting for a fill
+ *
+ */
+static int
+dcache_line_ready(APEX_CPU *cpu, int line)
+{
+	int way = dcache_lookup(cpu, line);
+	return way >= 0 && cpu->dcache.lines[line % DCACHE_SETS][way].ready_cycle <= cpu->clock + DCACHE_HIT_LATENCY;
+}
 
-            case OPCODE_RET:
-            {
-            	printf("RET rs1 src = %d, slot_id = %d, status = %d\n", cpu->rename_table[cpu->decode_rename1.rs1].src_bit,
-            			cpu->rename_table[cpu->decode_rename1.rs1].slot_id, cpu->phys_regs[cpu->rb.entries[cpu->rename_table[cpu->decode_rename1.rs1].slot_id].phy_address].status);
-            	if(cpu->rename_table[cpu->decode_rename1.rs1].src_bit == 0)
-            	{
-            		cpu->decode_rename1.p1 = cpu->decode_rename1.rs1;
-            		cpu->decode_rename1.p1_value = cpu->arch_regs[cpu->decode_rename1.rs1].value;
-            		cpu->stall = 0;
-            	}
-            	else
-            	{
-            		if(cpu->phys_regs[cpu->rb.entries[cpu->rename_table[cpu->decode_rename1.rs1].slot_id].phy_address].status == VALID)
-            		{
-            			cpu->decode_rename1.p1 = cpu->rename_table[cpu->decode_rename1.rs1].slot_id;
-            			cpu->decode_rename1.p1_value = cpu->phys_regs[cpu->rb.entries[cpu->rename_table[cpu->decode_rename1.rs1].slot_id].phy_address].value;
-            			cpu->stall = 0;
-            		}
-            		else
-            		{
-            			cpu->stall = 1;
-            		}
-            	}
-            	break;
-            }
-        }
-        /* Copy data from decode latch to debug decode latch*/
-        cpu->debug_decode_rename1 = cpu->decode_rename1;
-        if(!cpu->stall)
-        {
-            /* Copy data from decode latch to execute latch*/
-            cpu->rename2_dispatch = cpu->decode_rename1;
-            cpu->decode_rename1.has_insn = FALSE;
-        }
-    }
-    else
-    {
-    	cpu->debug_decode_rename1 = cpu->decode_rename1;
-    }
+/* Function to find the MSHR tracking an outstanding line
+ *
+ */
+static int
+find_mshr(APEX_CPU *cpu, int line)
+{
+	for(int i = 0; i < NUM_MSHRS; i++)
+	{
+		if(cpu->mshr.entries[i].valid && cpu->mshr.entries[i].line == line)
+		{
+			return i;
+		}
+	}
+	return -1;
 }
 
-/*
- * Rename2/Dispatch Stage of APEX Pipeline
+/* Function to get a free MSHR
+ *
+ */
+static int
+get_free_mshr(APEX_CPU *cpu)
+{
+	for(int i = 0; i < NUM_MSHRS; i++)
+	{
+		if(!cpu->mshr.entries[i].valid)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Function to mark the lsq entry of the load/store that has left
+ * for the LSU, entries are freed from the head in program order
+ * so that younger loads stay visible to older stores
  *
- * Note: You are free to edit this function according to your implementation
  */
 static void
-APEX_rename2_dispatch(APEX_CPU *cpu)
+release_load_store_queue_entry(APEX_CPU *cpu, int lid)
 {
-    if (cpu->rename2_dispatch.has_insn)
-    {
-        /* Read operands from register file based on the instruction type */
-        switch (cpu->rename2_dispatch.opcode)
-        {
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_MUL:
-            case OPCODE_DIV:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            case OPCODE_CMP:
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            case OPCODE_MOVC:
-            case OPCODE_HALT:
-            case OPCODE_NOP:
-            {
-            	check_r_to_r_instruction_dependency(cpu);
-                break;
-            }
+	cpu->lsq.entries[lid].issued = TRUE;
+	while(cpu->lsq.size > 0 && cpu->lsq.entries[cpu->lsq.front].issued)
+	{
+		cpu->lsq.entries[cpu->lsq.front].al = UN_ALLOCATED;
+		cpu->lsq.front = (cpu->lsq.front + 1) % LSQ_SIZE;
+		cpu->lsq.size--;
+	}
+}
 
-            case OPCODE_BP:
-            case OPCODE_BNP:
-            case OPCODE_BZ:
-            case OPCODE_BNZ:
-            case OPCODE_JALR:
-            case OPCODE_JUMP:
-            {
-            	if(cpu->rename2_dispatch.opcode == OPCODE_BZ)
-            	{
-            		printf("BZ RD2 ROB ID = %d, for CCR = %d", cpu->rename2_dispatch.p1, cpu->rename2_dispatch.rs1);
-            	}
-            	if(check_unresolved_btb_entry(cpu) >= 0)
-            	{
-            		cpu->d_stall = 1;
-            	}
-            	else
-            	{
-            		check_r_to_r_instruction_dependency(cpu);
-            	}
-            	break;
-            }
+/* Function to write the oldest retired store of the store buffer
+ * to the data cache, one store at a time in program order
+ *
+ */
+static void
+drain_store_buffer(APEX_CPU *cpu, unsigned int *banks_busy)
+{
+	SB_Entry *sb = &cpu->store_buffer.entries[cpu->store_buffer.front];
+
+	if(cpu->store_buffer.draining && cpu->store_buffer.drain_ready_cycle <= cpu->clock)
+	{
+		cpu->data_memory[sb->address] = sb->data;
+		cpu->store_buffer.front = (cpu->store_buffer.front + 1) % STORE_BUFFER_SIZE;
+		cpu->store_buffer.size--;
+		cpu->store_buffer.draining = FALSE;
+		sb = &cpu->store_buffer.entries[cpu->store_buffer.front];
+	}
+	if(!cpu->store_buffer.draining && cpu->store_buffer.size > 0 && sb->committed)
+	{
+		cpu->store_buffer.draining = TRUE;
+		cpu->store_buffer.drain_ready_cycle = cpu->clock + dcache_access(cpu, sb->pc, sb->address);
+		if(MEM_TRACE)
+		{
+			mem_trace_record(cpu, sb->pc, sb->address, TRUE);
+		}
+		*banks_busy |= 1u << (sb->address % DCACHE_BANKS);
+	}
+}
+
+/* Function to check the younger loads that issued speculatively
+ * past a store which is now issuing, the oldest one that read the
+ * same address is re-executed when it reaches the ROB head
+ *
+ */
+static void
+check_memory_order_violation(APEX_CPU *cpu, int sid)
+{
+	for(int i = (sid + 1) % LSQ_SIZE; i != (cpu->lsq.rear + 1) % LSQ_SIZE; i = (i + 1) % LSQ_SIZE)
+	{
+		if(cpu->lsq.entries[i].al == ALLOCATED && cpu->lsq.entries[i].ls_bit == 0 &&
+		   cpu->lsq.entries[i].issued && cpu->lsq.entries[i].speculative &&
+		   cpu->lsq.entries[i].mem_address == cpu->lsq.entries[sid].mem_address)
+		{
+			cpu->rb.entries[cpu->lsq.entries[i].rob_id].excodes = EXCODE_MEMORY_ORDER_VIOLATION;
+			cpu->lsq.violations++;
+			if(STORE_SET_PREDICTOR)
+			{
+				store_set_train(cpu, cpu->lsq.entries[i].pc, cpu->lsq.entries[sid].pc);
+			}
+			break;
+		}
+	}
+}
+
+/* Function to read or write data memory for a load/store
+ * leaving the LSU
+ *
+ */
+static void
+perform_memory_access(APEX_CPU *cpu, MEM_FU_Stage *stage)
+{
+	if(stage->lsq_entry.ls_bit == 1)
+	{
+		/* Memory is written when the store drains from the store buffer */
+		stage->latch.data = stage->lsq_entry.src1_value;
+	}
+	else if(stage->lsq_entry.poisoned || stage->lsq_entry.bad_address)
+	{
+		stage->latch.data = 0;
+	}
+	else if(stage->lsq_entry.forwarded)
+	{
+		stage->latch.data = stage->lsq_entry.src1_value;
+	}
+	else
+	{
+		stage->latch.data = cpu->data_memory[stage->lsq_entry.mem_address];
+	}
+	stage->latch.ready = VALID;
+}
+
+/* Function to issue the selected lsq entry to a load/store pipe, a
+ * miss is parked in an MSHR so that the pipe can accept the next
+ * access. Returns FALSE when no MSHR can take the miss
+ *
+ */
+static int
+issue_load_store_instruction(APEX_CPU *cpu, int id, int p)
+{
+	LSQ_Entry *entry = &cpu->lsq.entries[id];
+	int line = entry->mem_address / DCACHE_LINE_SIZE;
+	int mshr_id = entry->bad_address ? -1 : find_mshr(cpu, line);
+	int latency;
+
+	if(entry->ls_bit == 1 && cpu->store_buffer.size == STORE_BUFFER_SIZE)
+	{
+		cpu->store_buffer.full_stalls++;
+		return FALSE;
+	}
+	if(entry->ls_bit == 0 && !entry->forwarded && !entry->bad_address && !cpu->runahead.active &&
+	   ((mshr_id >= 0 && cpu->mshr.entries[mshr_id].num_targets == MSHR_TARGETS) ||
+	    (mshr_id < 0 && !dcache_line_ready(cpu, line) && get_free_mshr(cpu) < 0)))
+	{
+		cpu->mshr.full_stalls++;
+		return FALSE;
+	}
+
+	if(id != cpu->lsq.front)
+	{
+		cpu->lsq.ooo_loads++;
+	}
+	if(entry->speculative)
+	{
+		cpu->lsq.speculative_loads++;
+	}
+	if(entry->ls_bit == 1)
+	{
+		entry->poisoned |= check_source_poisoned(cpu, entry->src1_src, entry->src1_tag);
+		if(!entry->poisoned && !entry->bad_address)
+		{
+			check_memory_order_violation(cpu, id);
+		}
+		store_set_issue(cpu, id);
+	}
+	else
+	{
+		cpu->store_set.loads++;
+		cpu->rb.entries[entry->rob_id].mem_address = entry->mem_address;
+	}
+
+	if(entry->ls_bit == 1)
+	{
+		/* Written to the cache from the store buffer after it retires,
+		 * a poisoned runahead store or a wrong path store outside data
+		 * memory is dropped */
+		if(!entry->poisoned && !entry->bad_address)
+		{
+			store_buffer_insert(cpu, entry);
+		}
+		latency = 1;
+	}
+	else if(entry->poisoned)
+	{
+		/* Address depends on the blocking miss, nothing to access */
+		latency = 1;
+	}
+	else if(entry->bad_address)
+	{
+		/* Wrong path address outside data memory, nothing to access */
+		latency = 1;
+	}
+	else if(entry->forwarded)
+	{
+		/* Data comes from an older store, no cache access */
+		cpu->lsq.forwarded_loads++;
+		if(entry->sb_forwarded)
+		{
+			cpu->store_buffer.forwarded_loads++;
+		}
+		latency = STORE_FORWARD_LATENCY;
+	}
+	else if(cpu->runahead.active && (mshr_id >= 0 || !dcache_line_ready(cpu, line)))
+	{
+		/* A miss during runahead only brings the line in as a
+		 * prefetch, the load goes on with a poisoned result */
+		if(dcache_lookup(cpu, line) < 0)
+		{
+			cpu->runahead.prefetches++;
+		}
+		dcache_access(cpu, entry->pc, entry->mem_address);
+		entry->poisoned = TRUE;
+		latency = DCACHE_HIT_LATENCY;
+	}
+	else if((latency = dcache_access(cpu, entry->pc, entry->mem_address)) > DCACHE_HIT_LATENCY || mshr_id >= 0)
+	{
+		/* Accesses to a line with an MSHR queue behind it to keep
+		 * memory order within the line */
+		if(mshr_id < 0)
+		{
+			mshr_id = get_free_mshr(cpu);
+			cpu->mshr.entries[mshr_id].valid = TRUE;
+			cpu->mshr.entries[mshr_id].line = line;
+			cpu->mshr.entries[mshr_id].ready_cycle = cpu->clock + latency;
+			cpu->mshr.entries[mshr_id].num_targets = 0;
+			cpu->mshr.primary_misses++;
+		}
+		else
+		{
+			/* Secondary miss merges with the outstanding request */
+			cpu->mshr.secondary_misses++;
+		}
+		cpu->mshr.entries[mshr_id].targets[cpu->mshr.entries[mshr_id].num_targets++] = *entry;
+		release_load_store_queue_entry(cpu, id);
+		return TRUE;
+	}
 
-            case OPCODE_RET:
-            {
-            	cpu->pc = cpu->rename2_dispatch.p1_value;
-            	cpu->fetch_from_next_cycle = TRUE;
-            	cpu->decode_rename1.has_insn = FALSE;
-            	break;
-            }
-			
-            case OPCODE_STORE:
-            case OPCODE_LOAD:
-            {
-                check_load_store_instruction_dependency(cpu);
-                break;
-            }
-        }
-        /* Copy data from decode latch to debug decode latch*/
-        cpu->debug_rename2_dispatch = cpu->rename2_dispatch;
-        if(cpu->d_stall == 0)
-        {
-        	if(cpu->rename2_dispatch.opcode == OPCODE_JUMP ||
-        	   cpu->rename2_dispatch.opcode == OPCODE_JALR ||
-			   cpu->rename2_dispatch.opcode == OPCODE_BP   ||
-			   cpu->rename2_dispatch.opcode == OPCODE_BNP  ||
-			   cpu->rename2_dispatch.opcode == OPCODE_BZ  ||
-			   cpu->rename2_dispatch.opcode == OPCODE_BNZ)
-        	{
-        		memcpy(cpu->backup_arch_regs, cpu->arch_regs, sizeof(ARCH_REG) * REG_FILE_SIZE);
-        		memcpy(cpu->backup_phys_regs, cpu->phys_regs, sizeof(PHYS_REG) * PHYS_REG_FILE_SIZE);
-        		memcpy(cpu->backup_rename_table, cpu->rename_table, sizeof(RENAME_TABLE) * REG_FILE_SIZE);
-        	}
-            /* Copy data from decode latch to execute latch*/
-            cpu->rename2_dispatch.has_insn = FALSE;
-        }
-    }
-    else
-    {
-    	cpu->debug_rename2_dispatch = cpu->rename2_dispatch;
-    }
+	cpu->execute_load_store[p].has_insn = 1;
+	cpu->execute_load_store[p].lsq_id = id;
+	cpu->execute_load_store[p].lsq_entry = *entry;
+	cpu->execute_load_store[p].delay = latency;
+	cpu->execute_load_store[p].latch.ready = 0;
+	cpu->execute_load_store[p].latch.reg_id = entry->rob_id;
+	release_load_store_queue_entry(cpu, id);
+	return TRUE;
 }
 
-/*
- * Function to get the next available IU instruction
+/* Function to hand one load/store whose line has arrived from
+ * its MSHR to the writeback slot of a pipe, oldest fill first
  *
- * Note: You are free to edit this function according to your implementation
  */
 static int
-get_next_available_iu_instruction(APEX_CPU *cpu)
+complete_mshr_target(APEX_CPU *cpu, int p)
 {
 	int id = -1;
-	unsigned int min = 0xFFFFFFFF;
-	for(int i = 0; i < IQ_SIZE; i++)
+	MEM_FU_Stage stage;
+	MSHR_Entry *mshr;
+
+	for(int i = 0; i < NUM_MSHRS; i++)
 	{
-		if(cpu->iq.entries[i].al == ALLOCATED &&
-		  (cpu->iq.entries[i].fu_type == OPCODE_ADD   ||
-		   cpu->iq.entries[i].fu_type == OPCODE_SUB   ||
-		   cpu->iq.entries[i].fu_type == OPCODE_AND   ||
-		   cpu->iq.entries[i].fu_type == OPCODE_OR    ||
-		   cpu->iq.entries[i].fu_type == OPCODE_XOR   ||
-		   cpu->iq.entries[i].fu_type == OPCODE_CMP   ||
-		   cpu->iq.entries[i].fu_type == OPCODE_ADDL  ||
-		   cpu->iq.entries[i].fu_type == OPCODE_SUBL  ||
-		   cpu->iq.entries[i].fu_type == OPCODE_LOAD  ||
-		   cpu->iq.entries[i].fu_type == OPCODE_STORE ||
-		   cpu->iq.entries[i].fu_type == OPCODE_NOP  ||
-		   cpu->iq.entries[i].fu_type == OPCODE_HALT ||
-		   cpu->iq.entries[i].fu_type == OPCODE_MOVC) &&
-		   cpu->iq.entries[i].src1_ready == VALID &&
-		   cpu->iq.entries[i].src2_ready == VALID)
+		if(cpu->mshr.entries[i].valid && cpu->mshr.entries[i].ready_cycle <= cpu->clock &&
+		   (id < 0 || cpu->mshr.entries[i].ready_cycle < cpu->mshr.entries[id].ready_cycle))
 		{
-			if(cpu->iq.entries[i].cycle < min)
-			{
-				id = i;
-				min = cpu->iq.entries[i].cycle;
-			}
+			id = i;
 		}
 	}
-	return id;
+	if(id < 0)
+	{
+		return FALSE;
+	}
+
+	mshr = &cpu->mshr.entries[id];
+	memset(&stage, 0, sizeof(MEM_FU_Stage));
+	stage.has_insn = 1;
+	stage.lsq_id = -1;
+	stage.rob_id = mshr->targets[0].rob_id;
+	stage.lsq_entry = mshr->targets[0];
+	stage.latch.reg_id = mshr->targets[0].rob_id;
+	perform_memory_access(cpu, &stage);
+	cpu->writeback_load[p] = stage;
+
+	mshr->num_targets--;
+	memmove(&mshr->targets[0], &mshr->targets[1], mshr->num_targets * sizeof(LSQ_Entry));
+	if(mshr->num_targets == 0)
+	{
+		mshr->valid = FALSE;
+	}
+	return TRUE;
 }
 
-/*
- * Function to get the next available MU instruction
+/* Function to sample the number of outstanding misses
  *
- * Note: You are free to edit this function according to your implementation
  */
-static int
-get_next_available_mu_instruction(APEX_CPU *cpu)
+static void
+update_mshr_occupancy(APEX_CPU *cpu)
 {
-	int id = -1;
-	unsigned int min = 0xFFFFFFFF;
-	for(int i = 0; i < IQ_SIZE; i++)
+	int outstanding = 0;
+	for(int i = 0; i < NUM_MSHRS; i++)
 	{
-		if(cpu->iq.entries[i].al == ALLOCATED &&
-		  (cpu->iq.entries[i].fu_type == OPCODE_MUL ||
-		   cpu->iq.entries[i].fu_type == OPCODE_DIV) &&
-		   cpu->iq.entries[i].src1_ready == VALID &&
-		   cpu->iq.entries[i].src2_ready == VALID)
+		if(cpu->mshr.entries[i].valid)
 		{
-			if(cpu->iq.entries[i].cycle < min)
-			{
-				id = i;
-				min = cpu->iq.entries[i].cycle;
-			}
+			outstanding++;
 		}
 	}
-	return id;
+	cpu->mshr.outstanding_cycles += outstanding;
+	if(outstanding > cpu->mshr.peak_outstanding)
+	{
+		cpu->mshr.peak_outstanding = outstanding;
+	}
 }
 
 /*
- * Function to get the next available Load Store instruction
+ * Function to execute Load Store FU
  *
  * Note: You are free to edit this function according to your implementation
  */
-static int
-get_next_available_load_store_instruction(APEX_CPU *cpu)
+static void
+execute_load_store(APEX_CPU *cpu)
 {
 	int id = -1;
-	if(cpu->lsq.size > 0)
+	int issued = 0;
+	unsigned int banks_busy = 0;
+	if(STORE_SET_PREDICTOR && cpu->clock % SSIT_CLEAR_INTERVAL == 0)
+	{
+		store_set_clear(cpu);
+	}
+	for(int p = 0; p < NUM_LS_PIPES; p++)
+	{
+		MEM_FU_Stage *stage = &cpu->execute_load_store[p];
+		int completed = FALSE;
+		if(stage->has_insn == 1)
+		{
+			stage->delay--;
+
+			if(stage->delay == 0)
+			{
+				perform_memory_access(cpu, stage);
+				cpu->debug_execute_load_store[p] = *stage;
+				cpu->writeback_load[p] = *stage;
+				stage->has_insn = 0;
+				completed = TRUE;
+			}
+			else
+			{
+				cpu->debug_execute_load_store[p] = *stage;
+			}
+		}
+		else
+		{
+			/* Last result has gone to writeback, stop forwarding it */
+			stage->latch.ready = 0;
+			cpu->debug_execute_load_store[p] = *stage;
+		}
+
+		/* Misses complete out of order whenever a writeback slot is free */
+		if(!completed)
+		{
+			complete_mshr_target(cpu, p);
+		}
+	}
+
+	drain_store_buffer(cpu, &banks_busy);
+
+	/* Free pipes take the oldest ready access of their kind, accesses
+	 * to a bank already used this cycle wait for the next one */
+	for(int p = 0; p < NUM_LS_PIPES; p++)
 	{
-		if(cpu->lsq.entries[cpu->lsq.front].al == ALLOCATED &&
-		   ((cpu->lsq.entries[cpu->lsq.front].ls_bit == 0 && cpu->lsq.entries[cpu->lsq.front].mem_valid == VALID) ||
-		    (cpu->lsq.entries[cpu->lsq.front].ls_bit == 1 && cpu->lsq.entries[cpu->lsq.front].mem_valid == VALID &&
-		     cpu->lsq.entries[cpu->lsq.front].data_ready == VALID)))
+		if(cpu->execute_load_store[p].has_insn == 1)
 		{
-			id = cpu->lsq.front;
-			//cpu->lsq.front = (cpu->lsq.front + 1) % LSQ_SIZE;
-			//cpu->lsq.size--;
+			continue;
 		}
+		id = get_next_available_load_store_instruction(cpu, p < NUM_LOAD_PIPES ? LOAD : STORE, banks_busy);
+		if(id < 0)
+		{
+			continue;
+		}
+		if(cpu->lsq.entries[id].ls_bit == 0 && !cpu->lsq.entries[id].forwarded && !cpu->lsq.entries[id].poisoned &&
+		   !cpu->lsq.entries[id].bad_address)
+		{
+			banks_busy |= 1u << (cpu->lsq.entries[id].mem_address % DCACHE_BANKS);
+		}
+		if(!issue_load_store_instruction(cpu, id, p))
+		{
+			break;
+		}
+		issued++;
 	}
-	return id;
+	if(issued > 1)
+	{
+		cpu->lsq.multi_issue_cycles++;
+	}
+	update_mshr_occupancy(cpu);
 }
 
 /*
- * Function to get the next available BU instruction
+ * Function to execute the AGU pipes, the address is written straight
+ * into the LSQ entry so the LSU can pick it up in the same cycle
  *
  * Note: You are free to edit this function according to your implementation
  */
-static int
-get_next_available_bu_instruction(APEX_CPU *cpu)
+static void
+execute_agu(APEX_CPU *cpu)
 {
 	int id = -1;
-	unsigned int min = 0xFFFFFFFF;
-	for(int i = 0; i < IQ_SIZE; i++)
+	for(int p = 0; p < NUM_AGU_PIPES; p++)
 	{
-		if(cpu->iq.entries[i].al == ALLOCATED &&
-		  (cpu->iq.entries[i].fu_type == OPCODE_BZ   ||
-		   cpu->iq.entries[i].fu_type == OPCODE_BNZ  ||
-		   cpu->iq.entries[i].fu_type == OPCODE_BP   ||
-		   cpu->iq.entries[i].fu_type == OPCODE_BNP  ||
-		   cpu->iq.entries[i].fu_type == OPCODE_JUMP ||
-		   cpu->iq.entries[i].fu_type == OPCODE_JALR ||
-		   cpu->iq.entries[i].fu_type == OPCODE_RET) &&
-		   cpu->iq.entries[i].src1_ready == VALID)
+		FU_Stage *stage = &cpu->execute_agu[p];
+		cpu->debug_execute_agu[p] = *stage;
+		if(stage->has_insn == 1)
 		{
-			if(cpu->iq.entries[i].cycle < min)
+			LSQ_Entry *entry = &cpu->lsq.entries[stage->iq_entry.lsq_id];
+			if(stage->iq_entry.fu_type == OPCODE_STORE)
 			{
-				id = i;
-				min = cpu->iq.entries[i].cycle;
+				entry->mem_address = stage->iq_entry.src2_value + stage->iq_entry.literal;
+				entry->poisoned = check_source_poisoned(cpu, stage->iq_entry.src2_src, stage->iq_entry.src2_tag);
+				if(entry->data_ready != VALID)
+				{
+					cpu->lsq.early_store_addresses++;
+				}
+			}
+			else
+			{
+				entry->mem_address = stage->iq_entry.src1_value + stage->iq_entry.literal;
+				entry->poisoned = check_source_poisoned(cpu, stage->iq_entry.src1_src, stage->iq_entry.src1_tag);
 			}
+			/* Only a wrong path access can fall outside data memory,
+			 * it never reaches the cache or memory */
+			entry->bad_address = entry->mem_address < 0 || entry->mem_address >= DATA_MEMORY_SIZE;
+			entry->mem_valid = VALID;
+			cpu->lsq.agu_addresses++;
+			stage->has_insn = 0;
+		}
+
+		id = get_next_available_agu_instruction(cpu);
+		if(id >= 0)
+		{
+			stage->has_insn = 1;
+			stage->delay = 1;
+			stage->iq_id = id;
+			stage->iq_entry = cpu->iq.entries[id];
+			stage->rob_id = cpu->iq.entries[id].rob_id;
+			/* Leaves the IQ right away so the next pipe cannot pick it,
+			 * the data of a split store is captured by the LSQ */
+			cpu->iq.entries[id].al = UN_ALLOCATED;
+			cpu->iq.size--;
 		}
 	}
-	return id;
 }
 
-/*
- * Function to execute Load Store FU
+/* Function to compute the result of an IU/MU instruction into
+ * the forwarding latch of its stage
  *
- * Note: You are free to edit this function according to your implementation
  */
 static void
-execute_load_store(APEX_CPU *cpu)
+compute_fu_result(FU_Stage *stage)
 {
-	int id = -1;
-	if(cpu->execute_load_store.has_insn == 1)
+	switch(stage->iq_entry.fu_type)
 	{
-		if(cpu->execute_load_store.delay == 2)
+		case OPCODE_ADD:
 		{
-			cpu->lsq.entries[cpu->execute_load_store.lsq_id].al = UN_ALLOCATED;
-			cpu->lsq.front = (cpu->execute_load_store.lsq_id + 1) % LSQ_SIZE;
-			cpu->lsq.size--;
+			stage->latch.data = stage->iq_entry.src1_value + stage->iq_entry.src2_value;
+			break;
 		}
-		cpu->execute_load_store.delay--;
-
-		if(cpu->execute_load_store.delay == 0)
+		case OPCODE_SUB:
+		{
+			stage->latch.data = stage->iq_entry.src1_value - stage->iq_entry.src2_value;
+			break;
+		}
+		case OPCODE_MUL:
 		{
-			if(cpu->execute_load_store.lsq_entry.ls_bit == 1)
+			stage->latch.data = stage->iq_entry.src1_value * stage->iq_entry.src2_value;
+			break;
+		}
+		case OPCODE_DIV:
+		{
+			/* A DIV on the wrong path can see a zero divisor before the
+			 * branch guarding it resolves, it must not trap the host */
+			if(stage->iq_entry.src2_value == 0)
 			{
-				cpu->data_memory[cpu->execute_load_store.lsq_entry.mem_address] = cpu->execute_load_store.lsq_entry.src1_value;
-				cpu->execute_load_store.latch.data = cpu->execute_load_store.lsq_entry.src1_value;
+				stage->latch.data = 0;
 			}
 			else
 			{
-				cpu->execute_load_store.latch.data = cpu->data_memory[cpu->execute_load_store.lsq_entry.mem_address];
-			}
-			cpu->execute_load_store.latch.ready = VALID;
-			cpu->debug_execute_load_store = cpu->execute_load_store;
-			cpu->writeback_load = cpu->execute_load_store;
-			cpu->execute_load_store.has_insn = 0;
-
-			id = get_next_available_load_store_instruction(cpu);
-			if(id >= 0)
-			{
-				cpu->execute_load_store.has_insn = 1;
-				cpu->execute_load_store.delay = 2;
-				cpu->execute_load_store.lsq_id = id;
-				cpu->execute_load_store.lsq_entry = cpu->lsq.entries[id];
-				cpu->execute_load_store.latch.ready = 0;
-				cpu->execute_load_store.latch.reg_id = cpu->execute_load_store.lsq_entry.rob_id;
+				stage->latch.data = stage->iq_entry.src1_value / stage->iq_entry.src2_value;
 			}
+			break;
 		}
-		else
+		case OPCODE_AND:
 		{
-			cpu->debug_execute_load_store = cpu->execute_load_store;
+			stage->latch.data = stage->iq_entry.src1_value & stage->iq_entry.src2_value;
+			break;
 		}
-	}
-	else
-	{
-		cpu->debug_execute_load_store = cpu->execute_load_store;
-		id = get_next_available_load_store_instruction(cpu);
-		if(id >= 0)
+		case OPCODE_OR:
+		{
+			stage->latch.data = stage->iq_entry.src1_value | stage->iq_entry.src2_value;
+			break;
+		}
+		case OPCODE_XOR:
+		{
+			stage->latch.data = stage->iq_entry.src1_value ^ stage->iq_entry.src2_value;
+			break;
+		}
+        case OPCODE_ADDL:
 		{
-			cpu->execute_load_store.has_insn = 1;
-			cpu->execute_load_store.delay = 2;
-			cpu->execute_load_store.lsq_id = id;
-			cpu->execute_load_store.lsq_entry = cpu->lsq.entries[id];
-			cpu->execute_load_store.latch.ready = 0;
-			cpu->execute_load_store.latch.reg_id = cpu->execute_load_store.lsq_entry.rob_id;
+			stage->latch.data = stage->iq_entry.src1_value + stage->iq_entry.literal;
+			break;
+		}
+        case OPCODE_SUBL:
+		{
+			stage->latch.data = stage->iq_entry.src1_value - stage->iq_entry.literal;
+			break;
+		}
+        case OPCODE_MOVC:
+		{
+			/* MOVC does not set the flags */
+			stage->latch.data = stage->iq_entry.literal;
+			stage->latch.ready = VALID;
+			return;
 		}
+		case OPCODE_CMP:
+		{
+            stage->latch.z_flag = stage->iq_entry.src1_value == stage->iq_entry.src2_value;
+            stage->latch.p_flag = stage->iq_entry.src1_value > stage->iq_entry.src2_value;
+			return;
+		}
+        default:
+		{
+			/* HALT and NOP only complete in the rob */
+			return;
+		}
+	}
+	stage->latch.ready = VALID;
+	stage->latch.z_flag = stage->latch.data == 0;
+	stage->latch.p_flag = stage->latch.data > 0;
+}
+
+/* Function to find the latency of a DIV on an iterative divider.
+ * With DIV_EARLY_OUT it only iterates over the quotient bits left
+ * once the leading zeros of both operands are skipped
+ *
+ */
+static int
+get_div_latency(const FU_Unit *unit, const IQ_Entry *entry)
+{
+	unsigned int dividend = entry->src1_value < 0 ? -(unsigned int)entry->src1_value : (unsigned int)entry->src1_value;
+	unsigned int divisor = entry->src2_value < 0 ? -(unsigned int)entry->src2_value : (unsigned int)entry->src2_value;
+	int quotient_bits = 0;
+	int latency;
+
+	if(!DIV_EARLY_OUT || divisor == 0)
+	{
+		return unit->latency;
+	}
+	while(dividend >> quotient_bits)
+	{
+		quotient_bits++;
+	}
+	for(unsigned int d = divisor; d > 1; d >>= 1)
+	{
+		quotient_bits--;
 	}
+	latency = quotient_bits > 0 ? (quotient_bits + DIV_BITS_PER_CYCLE - 1) / DIV_BITS_PER_CYCLE : 1;
+	return latency < unit->latency ? latency : unit->latency;
 }
 
 /*
- * Function to execute IU FU
+ * Function to advance an instruction in flight on a unit of the
+ * functional unit pool. The IQ entry is released when it starts and
+ * its result goes to writeback once the delay has run out
  *
  * Note: You are free to edit this function according to your implementation
  */
 static void
-execute_iu(APEX_CPU *cpu)
+execute_fu_slot(APEX_CPU *cpu, int u, FU_Stage *stage)
 {
-	int id = -1;
-	if(cpu->execute_iu.has_insn == 1)
+	FU_Unit *unit = &cpu->fu_pool[u];
+
+	if(stage->has_insn == 0)
+	{
+		/* Last result has gone to writeback, stop forwarding it */
+		stage->latch.ready = 0;
+		return;
+	}
+	if(stage->delay == unit->latency)
 	{
-		cpu->iq.entries[cpu->execute_iu.iq_id].al = UN_ALLOCATED;
+		cpu->iq.entries[stage->iq_id].al = UN_ALLOCATED;
 		cpu->iq.size--;
-		cpu->execute_iu.delay--;
-		if(cpu->execute_iu.delay == 0)
+		if(stage->iq_entry.fu_type == OPCODE_DIV)
 		{
-			switch(cpu->execute_iu.iq_entry.fu_type)
-			{
-				case OPCODE_ADD:
-				{
-					cpu->execute_iu.latch.data = cpu->execute_iu.iq_entry.src1_value + cpu->execute_iu.iq_entry.src2_value;
-					cpu->execute_iu.latch.ready = VALID;
-	                if (cpu->execute_iu.latch.data == 0)
-	                {
-	                	cpu->execute_iu.latch.z_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.z_flag = FALSE;
-	                }
-	                if (cpu->execute_iu.latch.data > 0)
-	                {
-	                	cpu->execute_iu.latch.p_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.p_flag = FALSE;
-	                }
-					cpu->writeback_iu = cpu->execute_iu;
-					break;
-				}
-				case OPCODE_SUB:
-				{
-					cpu->execute_iu.latch.data = cpu->execute_iu.iq_entry.src1_value - cpu->execute_iu.iq_entry.src2_value;
-					cpu->execute_iu.latch.ready = VALID;
-	                if (cpu->execute_iu.latch.data == 0)
-	                {
-	                	cpu->execute_iu.latch.z_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.z_flag = FALSE;
-	                }
-	                if (cpu->execute_iu.latch.data > 0)
-	                {
-	                	cpu->execute_iu.latch.p_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.p_flag = FALSE;
-	                }
-					cpu->writeback_iu = cpu->execute_iu;
-					break;
-				}
-				case OPCODE_AND:
-				{
-					cpu->execute_iu.latch.data = cpu->execute_iu.iq_entry.src1_value & cpu->execute_iu.iq_entry.src2_value;
-					cpu->execute_iu.latch.ready = VALID;
-	                if (cpu->execute_iu.latch.data == 0)
-	                {
-	                	cpu->execute_iu.latch.z_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.z_flag = FALSE;
-	                }
-	                if (cpu->execute_iu.latch.data > 0)
-	                {
-	                	cpu->execute_iu.latch.p_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.p_flag = FALSE;
-	                }
-					cpu->writeback_iu = cpu->execute_iu;
-					break;
-				}
-				case OPCODE_OR:
-				{
-					cpu->execute_iu.latch.data = cpu->execute_iu.iq_entry.src1_value | cpu->execute_iu.iq_entry.src2_value;
-					cpu->execute_iu.latch.ready = VALID;
-	                if (cpu->execute_iu.latch.data == 0)
-	                {
-	                	cpu->execute_iu.latch.z_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.z_flag = FALSE;
-	                }
-	                if (cpu->execute_iu.latch.data > 0)
-	                {
-	                	cpu->execute_iu.latch.p_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.p_flag = FALSE;
-	                }
-					cpu->writeback_iu = cpu->execute_iu;
-					break;
-				}
-				case OPCODE_XOR:
-				{
-					cpu->execute_iu.latch.data = cpu->execute_iu.iq_entry.src1_value ^ cpu->execute_iu.iq_entry.src2_value;
-					cpu->execute_iu.latch.ready = VALID;
-	                if (cpu->execute_iu.latch.data == 0)
-	                {
-	                	cpu->execute_iu.latch.z_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.z_flag = FALSE;
-	                }
-	                if (cpu->execute_iu.latch.data > 0)
-	                {
-	                	cpu->execute_iu.latch.p_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.p_flag = FALSE;
-	                }
-					cpu->writeback_iu = cpu->execute_iu;
-					break;
-				}
-				case OPCODE_CMP:
-				{
-	                if (cpu->execute_iu.iq_entry.src1_value == cpu->execute_iu.iq_entry.src2_value)
-	                {
-	                	cpu->execute_iu.latch.z_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.z_flag = FALSE;
-	                }
-	                if (cpu->execute_iu.iq_entry.src1_value > cpu->execute_iu.iq_entry.src2_value)
-	                {
-	                	cpu->execute_iu.latch.p_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.p_flag = FALSE;
-	                }
-					break;
-				}
-
-		        case OPCODE_STORE:
-				{
-					cpu->execute_iu.latch.data = cpu->execute_iu.iq_entry.src2_value + cpu->execute_iu.iq_entry.literal;
-					cpu->execute_iu.latch.ready = VALID;
-					cpu->writeback_iu = cpu->execute_iu;
-					break;
-				}
+			stage->delay = get_div_latency(unit, &stage->iq_entry);
+		}
+		unit->issued++;
+		unit->latency_sum += stage->delay;
+	}
+	stage->delay--;
+	if(stage->delay > 0)
+	{
+		return;
+	}
+	compute_fu_result(stage);
+	/* CMP only leaves its flags in the forwarding latch */
+	if(stage->iq_entry.fu_type != OPCODE_CMP)
+	{
+		cpu->writeback_fu[u] = *stage;
+	}
+	stage->has_insn = 0;
+}
 
-		        case OPCODE_LOAD:
-				{
-					cpu->execute_iu.latch.data = cpu->execute_iu.iq_entry.src1_value + cpu->execute_iu.iq_entry.literal;
-					cpu->execute_iu.latch.ready = VALID;
-					cpu->writeback_iu = cpu->execute_iu;
-					break;
-				}
+/*
+ * Function to execute a unit of the functional unit pool. Every
+ * instruction in flight advances by one cycle, then the unit selects
+ * the next instruction if it has a free slot. A pipelined unit has
+ * one slot per cycle of latency, so it can start an instruction every
+ * cycle while the others wait for the previous one to finish
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+execute_fu(APEX_CPU *cpu, int u)
+{
+	FU_Unit *unit = &cpu->fu_pool[u];
+	FU_Stage *stage = NULL;
+	int busy = FALSE;
+	int id;
 
-		        case OPCODE_ADDL:
-				{
-					cpu->execute_iu.latch.data = cpu->execute_iu.iq_entry.src1_value + cpu->execute_iu.iq_entry.literal;
-					cpu->execute_iu.latch.ready = VALID;
-	                if (cpu->execute_iu.latch.data == 0)
-	                {
-	                	cpu->execute_iu.latch.z_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.z_flag = FALSE;
-	                }
-	                if (cpu->execute_iu.latch.data > 0)
-	                {
-	                	cpu->execute_iu.latch.p_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.p_flag = FALSE;
-	                }
-					cpu->writeback_iu = cpu->execute_iu;
-					break;
-				}
+	for(int k = 0; k < unit->slots; k++)
+	{
+		busy |= cpu->execute_fu[u][k].has_insn;
+		execute_fu_slot(cpu, u, &cpu->execute_fu[u][k]);
+		cpu->debug_execute_fu[u][k] = cpu->execute_fu[u][k];
+		if(cpu->execute_fu[u][k].has_insn == 0 && stage == NULL)
+		{
+			stage = &cpu->execute_fu[u][k];
+		}
+	}
+	if(busy)
+	{
+		unit->busy_cycles++;
+	}
 
-		        case OPCODE_SUBL:
-				{
-					cpu->execute_iu.latch.data = cpu->execute_iu.iq_entry.src1_value - cpu->execute_iu.iq_entry.literal;
-					cpu->execute_iu.latch.ready = VALID;
-	                if (cpu->execute_iu.latch.data == 0)
-	                {
-	                	cpu->execute_iu.latch.z_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.z_flag = FALSE;
-	                }
-	                if (cpu->execute_iu.latch.data > 0)
-	                {
-	                	cpu->execute_iu.latch.p_flag = TRUE;
-	                }
-	                else
-	                {
-	                	cpu->execute_iu.latch.p_flag = FALSE;
-	                }
-					cpu->writeback_iu = cpu->execute_iu;
-					break;
-				}
+	id = get_next_available_fu_instruction(cpu, u);
+	if(id >= 0 && stage == NULL)
+	{
+		unit->blocked_cycles++;
+	}
+	else if(id >= 0)
+	{
+		stage->has_insn = 1;
+		stage->delay = unit->latency;
+		stage->iq_id = id;
+		stage->iq_entry = cpu->iq.entries[id];
+		stage->latch.ready = 0;
+		stage->latch.reg_id = stage->iq_entry.rob_id;
+	}
+}
 
-		        case OPCODE_MOVC:
-				{
-					cpu->execute_iu.latch.data = cpu->execute_iu.iq_entry.literal;
-					cpu->execute_iu.latch.ready = VALID;
-					cpu->writeback_iu = cpu->execute_iu;
-					break;
-				}
-		        case OPCODE_HALT:
-		        case OPCODE_NOP:
-				{
-					cpu->writeback_iu = cpu->execute_iu;
-					break;
-				}
-			}
-			cpu->debug_execute_iu = cpu->execute_iu;
-			cpu->execute_iu.has_insn = 0;
-			id = get_next_available_iu_instruction(cpu);
-			if(id >= 0)
+/* Function to resolve a control transfer in the branch unit. The
+ * predictors and the btb learn the outcome, a next PC other than the
+ * one fetch went to is flushed at writeback
+ *
+ */
+static void
+resolve_branch(APEX_CPU *cpu, FU_Stage *stage, int taken, int target)
+{
+	const IQ_Entry *entry = &stage->iq_entry;
+
+	stage->target = taken ? target : entry->pc + INSTRUCTION_SIZE;
+	stage->change_control = stage->target != entry->prediction.target;
+	stage->misprediction = FALSE;
+	if(check_conditional_branch(entry->fu_type))
+	{
+		train_branch_predictor(cpu, entry->pc, entry->prediction.history, taken);
+		cpu->rb.entries[entry->rob_id].taken = taken;
+		stage->misprediction = stage->change_control;
+		if(!cpu->runahead.active)
+		{
+			cpu->bpred.branches++;
+			if(entry->prediction.direction != taken)
 			{
-				cpu->execute_iu.has_insn = 1;
-				cpu->execute_iu.delay = 1;
-				cpu->execute_iu.iq_id = id;
-				cpu->execute_iu.iq_entry = cpu->iq.entries[id];
-				cpu->execute_iu.latch.ready = 0;
-				cpu->execute_iu.latch.reg_id = cpu->execute_iu.iq_entry.rob_id;
+				cpu->bpred.mispredicted++;
 			}
 		}
-		else
+	}
+	if(entry->fu_type == OPCODE_RET && RETURN_ADDRESS_STACK && !cpu->runahead.active)
+	{
+		cpu->tpred.returns++;
+		cpu->tpred.returns_correct += !stage->change_control;
+	}
+	if(check_indirect_jump(entry->fu_type) && INDIRECT_PREDICTOR)
+	{
+		update_indirect_target(cpu, entry->pc, entry->prediction.history, target);
+		if(!cpu->runahead.active)
 		{
-			cpu->debug_execute_iu = cpu->execute_iu;
+			cpu->tpred.jumps++;
+			cpu->tpred.indirect_hits += entry->prediction.indirect_hit;
+			cpu->tpred.jumps_correct += !stage->change_control;
 		}
 	}
-	else
+	if(taken)
 	{
-		cpu->debug_execute_iu = cpu->execute_iu;
-		id = get_next_available_iu_instruction(cpu);
-		if(id >= 0)
+		update_btb_entry(cpu, entry->pc, entry->fu_type, target);
+	}
+}
+
+/* Function to flush the instructions fetched after a control transfer
+ * that went to the wrong next PC. The global history and the return
+ * address stack are repaired from the checkpoint of the branch and
+ * what the branch itself does to them
+ *
+ */
+static void
+redirect_after_branch(APEX_CPU *cpu, FU_Stage *stage)
+{
+	flush_instructions_after_branch(cpu, stage->iq_entry.rob_id, stage->target);
+	restore_prediction_checkpoint(cpu, &stage->iq_entry.prediction);
+	if(check_conditional_branch(stage->iq_entry.fu_type))
+	{
+		cpu->bpred.history = (cpu->bpred.history << 1) | cpu->rb.entries[stage->iq_entry.rob_id].taken;
+	}
+	if(stage->iq_entry.fu_type == OPCODE_JALR && RETURN_ADDRESS_STACK)
+	{
+		ras_push(&cpu->tpred.ras, stage->iq_entry.pc + INSTRUCTION_SIZE);
+	}
+	if(stage->iq_entry.fu_type == OPCODE_RET && RETURN_ADDRESS_STACK)
+	{
+		ras_pop(&cpu->tpred.ras);
+	}
+	if(stage->misprediction == 1)
+	{
+		cpu->misprediction = 1;
+		cpu->misprediction_clock = stage->iq_entry.cycle;
+		stage->misprediction = 0;
+	}
+	cpu->ftq.resume_cycle = cpu->clock + BRANCH_REDIRECT_PENALTY;
+	if(!cpu->runahead.active)
+	{
+		BRANCH_PENALTY *penalty = &cpu->bpred.penalties[get_code_memory_index_from_pc(stage->iq_entry.pc)];
+
+		cpu->bpred.redirects++;
+		penalty->redirects++;
+		penalty->cycles += cpu->clock - stage->iq_entry.cycle + BRANCH_REDIRECT_PENALTY;
+	}
+}
+
+/* Function to get the branch unit holding the oldest branch, -1
+ * when all are empty
+ *
+ */
+static int
+get_oldest_bu_stage(APEX_CPU *cpu)
+{
+	int oldest = -1;
+	int min = ROB_SIZE;
+	for(int b = 0; b < NUM_BU_UNITS; b++)
+	{
+		if(cpu->execute_bu[b].has_insn == 1 && get_rob_age(cpu, cpu->execute_bu[b].iq_entry.rob_id) < min)
 		{
-			cpu->execute_iu.has_insn = 1;
-			cpu->execute_iu.delay = 1;
-			cpu->execute_iu.iq_id = id;
-			cpu->execute_iu.iq_entry = cpu->iq.entries[id];
-			cpu->execute_iu.latch.ready = 0;
-			cpu->execute_iu.latch.reg_id = cpu->execute_iu.iq_entry.rob_id;
+			oldest = b;
+			min = get_rob_age(cpu, cpu->execute_bu[b].iq_entry.rob_id);
 		}
 	}
+	return oldest;
 }
 
-/*
- * Function to execute MU FU
+/* Function to resolve the branch a branch unit took from the IQ
+ * last cycle and pass it on to the writeback of the unit
  *
- * Note: You are free to edit this function according to your implementation
  */
 static void
-execute_mu(APEX_CPU *cpu)
+resolve_bu_stage(APEX_CPU *cpu, int b)
 {
-	int id = -1;
-	if(cpu->execute_mu.has_insn == 1)
+	FU_Stage *stage = &cpu->execute_bu[b];
+
+	cpu->iq.entries[stage->iq_id].al = UN_ALLOCATED;
+	cpu->iq.size--;
+	switch(stage->iq_entry.fu_type)
 	{
-		if(cpu->execute_mu.delay == 4)
+		case OPCODE_BZ:
+		case OPCODE_BNZ:
+		case OPCODE_BP:
+		case OPCODE_BNP:
 		{
-			cpu->iq.entries[cpu->execute_mu.iq_id].al = UN_ALLOCATED;
-			cpu->iq.size--;
+			printf("BZ src1 = %d, z-flag = %d, p-flag = %d\n", stage->iq_entry.src1_tag, stage->iq_entry.z_flag, stage->iq_entry.p_flag);
+			resolve_branch(cpu, stage,
+					(stage->iq_entry.fu_type == OPCODE_BZ  && stage->iq_entry.z_flag == TRUE) ||
+					(stage->iq_entry.fu_type == OPCODE_BNZ && stage->iq_entry.z_flag == FALSE)||
+					(stage->iq_entry.fu_type == OPCODE_BP  && stage->iq_entry.p_flag == TRUE) ||
+					(stage->iq_entry.fu_type == OPCODE_BNP && stage->iq_entry.p_flag == FALSE),
+					stage->iq_entry.pc + stage->iq_entry.literal);
+			break;
 		}
 
-		cpu->execute_mu.delay--;
-		if(cpu->execute_mu.delay == 0)
+		case OPCODE_JUMP:
 		{
-			switch(cpu->execute_mu.iq_entry.fu_type)
-			{
-				case OPCODE_MUL:
-				{
-					cpu->execute_mu.latch.data = cpu->execute_mu.iq_entry.src1_value * cpu->execute_mu.iq_entry.src2_value;
-					break;
-				}
+			resolve_branch(cpu, stage, TRUE, stage->iq_entry.src1_value + stage->iq_entry.literal);
+			break;
+		}
 
-				case OPCODE_DIV:
-				{
-					cpu->execute_mu.latch.data = cpu->execute_mu.iq_entry.src1_value / cpu->execute_mu.iq_entry.src2_value;
-					break;
-				}
-			}
-            if (cpu->execute_mu.latch.data == 0)
-            {
-            	cpu->execute_mu.latch.z_flag = TRUE;
-            }
-            else
-            {
-            	cpu->execute_mu.latch.z_flag = FALSE;
-            }
-            if (cpu->execute_mu.latch.data > 0)
-            {
-            	cpu->execute_mu.latch.p_flag = TRUE;
-            }
-            else
-            {
-            	cpu->execute_mu.latch.p_flag = FALSE;
-            }
-			cpu->execute_mu.latch.ready = 1;
-			cpu->debug_execute_mu = cpu->execute_mu;
-			cpu->writeback_mu = cpu->execute_mu;
-			cpu->execute_mu.has_insn = 0;
-			id = get_next_available_mu_instruction(cpu);
-			if(id >= 0)
-			{
-				cpu->execute_mu.has_insn = 1;
-				cpu->execute_mu.delay = 4;
-				cpu->execute_mu.iq_id = id;
-				cpu->execute_mu.iq_entry = cpu->iq.entries[id];
-				cpu->execute_mu.latch.ready = 0;
-				cpu->execute_mu.latch.reg_id = cpu->execute_mu.iq_entry.rob_id;
-			}
+		case OPCODE_JALR:
+		{
+			stage->latch.data = stage->iq_entry.pc + INSTRUCTION_SIZE;
+			printf("ExecuteBU JALR latch data = %d", stage->latch.data);
+			printf("JALR src1_value = %d, literal = %d \n", stage->iq_entry.src1_value, stage->iq_entry.literal);
+			resolve_branch(cpu, stage, TRUE, stage->iq_entry.src1_value + stage->iq_entry.literal);
+			break;
 		}
-		else
+
+		case OPCODE_RET:
 		{
-			cpu->debug_execute_mu = cpu->execute_mu;
+			resolve_branch(cpu, stage, TRUE, stage->iq_entry.src1_value);
+			break;
 		}
 	}
-	else
+
+	if(runahead_poison_result(cpu, &stage->iq_entry))
 	{
-		cpu->debug_execute_mu = cpu->execute_mu;
-		id = get_next_available_mu_instruction(cpu);
-		if(id >= 0)
-		{
-			cpu->execute_mu.has_insn = 1;
-			cpu->execute_mu.delay = 4;
-			cpu->execute_mu.iq_id = id;
-			cpu->execute_mu.iq_entry = cpu->iq.entries[id];
-			cpu->execute_mu.latch.ready = 0;
-			cpu->execute_mu.latch.reg_id = cpu->execute_mu.iq_entry.rob_id;
-		}
+		/* Outcome of a poisoned branch is unknown, runahead
+		 * keeps following the prediction */
+		stage->change_control = 0;
+		stage->misprediction = 0;
+	}
+	/* Fetch is redirected and the younger instructions
+	 * squashed in the cycle the branch resolves */
+	if(stage->change_control == 1)
+	{
+		redirect_after_branch(cpu, stage);
 	}
+
+	stage->latch.ready = 1;
+	cpu->writeback_bu[b] = *stage;
+	cpu->debug_execute_bu[b] = *stage;
+	stage->has_insn = 0;
 }
 
 /*
@@ -2883,165 +5422,31 @@ execute_mu(APEX_CPU *cpu)
 static void
 execute_bu(APEX_CPU *cpu)
 {
-	int id;
-	if(cpu->execute_bu.has_insn == 1)
-	{
-		cpu->iq.entries[cpu->execute_bu.iq_id].al = UN_ALLOCATED;
-		cpu->iq.size--;
-		cpu->execute_bu.delay--;
-		if(cpu->execute_bu.delay == 0)
-		{
-			switch(cpu->execute_bu.iq_entry.fu_type)
-			{
-				case OPCODE_BZ:
-				case OPCODE_BNZ:
-				case OPCODE_BP:
-				case OPCODE_BNP:
-				{
-					printf("BZ src1 = %d, z-flag = %d, p-flag = %d\n", cpu->execute_bu.iq_entry.src1_tag, cpu->execute_bu.iq_entry.z_flag, cpu->execute_bu.iq_entry.p_flag);
-					if((cpu->execute_bu.iq_entry.fu_type == OPCODE_BZ  && cpu->execute_bu.iq_entry.z_flag == TRUE) ||
-					   (cpu->execute_bu.iq_entry.fu_type == OPCODE_BNZ && cpu->execute_bu.iq_entry.z_flag == FALSE)||
-					   (cpu->execute_bu.iq_entry.fu_type == OPCODE_BP  && cpu->execute_bu.iq_entry.p_flag == TRUE) ||
-					   (cpu->execute_bu.iq_entry.fu_type == OPCODE_BNP && cpu->execute_bu.iq_entry.p_flag == FALSE))
-					{
-						printf("BZ branch taken\n");
-						if(cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].history == -1)
-						{
-							cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].target = cpu->execute_bu.iq_entry.pc + cpu->execute_bu.iq_entry.literal;
-							cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].history = 1;
-							cpu->execute_bu.change_control = 1;
-							cpu->execute_bu.misprediction = 0;
-						}
-						else
-						{
-							if(cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].prediction == 0)
-							{
-								cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].target = cpu->execute_bu.iq_entry.pc + cpu->execute_bu.iq_entry.literal;
-								cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].history = 1;
-								// Need to take the branch
-								cpu->execute_bu.change_control = 1;
-								cpu->execute_bu.misprediction = 0;
-							}
-							else
-							{
-								cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].target = cpu->execute_bu.iq_entry.pc + cpu->execute_bu.iq_entry.literal;
-								cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].history = 1;
-								// Branch already taken
-								cpu->execute_bu.change_control = 0;
-								cpu->execute_bu.misprediction = 0;
-							}
-						}
-					}
-					else
-					{
-						if(cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].history == -1)
-						{
-							cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].target = cpu->execute_bu.iq_entry.pc + cpu->execute_bu.iq_entry.literal;
-							cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].history = 0;
-							cpu->execute_bu.change_control = 0;
-							cpu->execute_bu.misprediction = 0;
-						}
-						else
-						{
-							if(cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].prediction == 0)
-							{
-								cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].target = cpu->execute_bu.iq_entry.pc + cpu->execute_bu.iq_entry.literal;
-								cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].history = 0;
-								// Branch already not taken
-								cpu->execute_bu.change_control = 0;
-								cpu->execute_bu.misprediction = 0;
-							}
-							else
-							{
-								cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].target = cpu->execute_bu.iq_entry.pc + cpu->execute_bu.iq_entry.literal;
-								cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].history = 0;
-								// Branch already taken (mispredicted)
-								cpu->execute_bu.change_control = 0;
-								cpu->execute_bu.misprediction = 1;
-							}
-						}
-					}
-
-					cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].resolved = 1;
-					break;
-				}
-
-				case OPCODE_JUMP:
-				{
-					cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].target = cpu->execute_bu.iq_entry.src1_value + cpu->execute_bu.iq_entry.literal;
-					cpu->execute_bu.misprediction = 0;
-					if(cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].history == -1)
-					{
-						cpu->execute_bu.change_control = 1;
-					}
-					else
-					{
-						cpu->execute_bu.change_control = 0;
-					}
-					cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].history = 1;
-					cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].resolved = 1;
-					break;
-				}
-
-				case OPCODE_JALR:
-				{
-					cpu->execute_bu.latch.data = cpu->execute_bu.iq_entry.pc + INSTRUCTION_SIZE;
-					printf("ExecuteBU JALR latch data = %d", cpu->execute_bu.latch.data);
-					cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].target = cpu->execute_bu.iq_entry.src1_value + cpu->execute_bu.iq_entry.literal;
-					printf("JALR src1_value = %d, literal = %d \n", cpu->execute_bu.iq_entry.src1_value, cpu->execute_bu.iq_entry.literal);
-
-					if(cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].history == -1)
-					{
-						cpu->execute_bu.change_control = 1;
-					}
-					else
-					{
-						cpu->execute_bu.change_control = 0;
-					}
-					cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].history = 1;
-					cpu->btb.entries[cpu->execute_bu.iq_entry.btb_id].resolved = 1;
-					break;
-				}
-
-				case OPCODE_RET:
-				{
-					break;
-				}
-			}
+	int b, id;
 
-			cpu->execute_bu.latch.ready = 1;
-			cpu->writeback_bu = cpu->execute_bu;
-			cpu->debug_execute_bu = cpu->execute_bu;
-			cpu->execute_bu.has_insn = 0;
-			id = get_next_available_bu_instruction(cpu);
-			if(id >= 0)
-			{
-				cpu->execute_bu.has_insn = 1;
-				cpu->execute_bu.delay = 1;
-				cpu->execute_bu.iq_id = id;
-				cpu->execute_bu.iq_entry = cpu->iq.entries[id];
-				cpu->execute_bu.latch.ready = 0;
-				cpu->execute_bu.latch.reg_id = cpu->execute_bu.iq_entry.rob_id;
-			}
-		}
-		else
-		{
-			cpu->debug_execute_bu = cpu->execute_bu;
-		}
+	for(b = 0; b < NUM_BU_UNITS; b++)
+	{
+		cpu->debug_execute_bu[b] = cpu->execute_bu[b];
 	}
-	else
+	/* Oldest first, so that a redirect squashes the younger branches
+	 * before they train the predictors */
+	while((b = get_oldest_bu_stage(cpu)) >= 0)
+	{
+		resolve_bu_stage(cpu, b);
+	}
+	for(b = 0; b < NUM_BU_UNITS; b++)
 	{
-		cpu->debug_execute_bu = cpu->execute_bu;
 		id = get_next_available_bu_instruction(cpu);
-		if(id >= 0)
+		if(id < 0)
 		{
-			cpu->execute_bu.has_insn = 1;
-			cpu->execute_bu.delay = 1;
-			cpu->execute_bu.iq_id = id;
-			cpu->execute_bu.iq_entry = cpu->iq.entries[id];
-			cpu->execute_bu.latch.ready = 0;
-			cpu->execute_bu.latch.reg_id = cpu->execute_bu.iq_entry.rob_id;
+			break;
 		}
+		cpu->execute_bu[b].has_insn = 1;
+		cpu->execute_bu[b].delay = 1;
+		cpu->execute_bu[b].iq_id = id;
+		cpu->execute_bu[b].iq_entry = cpu->iq.entries[id];
+		cpu->execute_bu[b].latch.ready = 0;
+		cpu->execute_bu[b].latch.reg_id = cpu->execute_bu[b].iq_entry.rob_id;
 	}
 }
 
@@ -3053,59 +5458,79 @@ execute_bu(APEX_CPU *cpu)
 static void
 APEX_execute(APEX_CPU *cpu)
 {
-	execute_iu(cpu);
-	execute_mu(cpu);
+	for(int u = 0; u < NUM_FUS; u++)
+	{
+		execute_fu(cpu, u);
+	}
 	execute_bu(cpu);
+	execute_agu(cpu);
 	execute_load_store(cpu);
 }
 
+/* Function to check if an IU/MU instruction writes a physical
+ * register in writeback
+ *
+ */
+static int
+check_fu_result_writer(int opcode)
+{
+	return opcode == OPCODE_ADD  ||
+		   opcode == OPCODE_SUB  ||
+		   opcode == OPCODE_MUL  ||
+		   opcode == OPCODE_DIV  ||
+		   opcode == OPCODE_AND  ||
+		   opcode == OPCODE_OR   ||
+		   opcode == OPCODE_XOR  ||
+		   opcode == OPCODE_CMP  ||
+		   opcode == OPCODE_ADDL ||
+		   opcode == OPCODE_SUBL ||
+		   opcode == OPCODE_MOVC;
+}
+
 /*
- * Function to Writeback/Forward IU results
+ * Function to Writeback/Forward the result of a unit of the
+ * functional unit pool
  *
  * Note: You are free to edit this function according to your implementation
  */
 static void
-writeback_iu(APEX_CPU *cpu)
+writeback_fu(APEX_CPU *cpu, int u)
 {
-	cpu->debug_writeback_iu = cpu->writeback_iu;
-	if(cpu->writeback_iu.has_insn == 1)
+	FU_Stage *stage = &cpu->writeback_fu[u];
+
+	cpu->debug_writeback_fu[u] = *stage;
+	if(stage->has_insn == 1)
 	{
-		if(cpu->writeback_iu.iq_entry.fu_type == OPCODE_HALT || cpu->writeback_iu.iq_entry.fu_type == OPCODE_NOP)
+		runahead_poison_result(cpu, &stage->iq_entry);
+		if(stage->iq_entry.fu_type == OPCODE_HALT || stage->iq_entry.fu_type == OPCODE_NOP)
 		{
-			cpu->rb.entries[cpu->writeback_iu.iq_entry.rob_id].status = VALID;
+			cpu->rb.entries[stage->iq_entry.rob_id].status = VALID;
 		}
-		else if(cpu->writeback_iu.latch.ready == 1)
+		else if(stage->latch.ready == 1)
 		{
-			cpu->writeback_iu.latch.ready = 0;
-			if(cpu->writeback_iu.iq_entry.fu_type == OPCODE_ADD   ||
-			   cpu->writeback_iu.iq_entry.fu_type == OPCODE_SUB   ||
-			   cpu->writeback_iu.iq_entry.fu_type == OPCODE_OR    ||
-			   cpu->writeback_iu.iq_entry.fu_type == OPCODE_XOR   ||
-			   cpu->writeback_iu.iq_entry.fu_type == OPCODE_CMP   ||
-			   cpu->writeback_iu.iq_entry.fu_type == OPCODE_ADDL  ||
-			   cpu->writeback_iu.iq_entry.fu_type == OPCODE_SUBL  ||
-			   cpu->writeback_iu.iq_entry.fu_type == OPCODE_MOVC)
+			stage->latch.ready = 0;
+			if(check_fu_result_writer(stage->iq_entry.fu_type))
 		    {
-				cpu->phys_regs[cpu->rb.entries[cpu->writeback_iu.latch.reg_id].phy_address].value  = cpu->writeback_iu.latch.data;
-				cpu->phys_regs[cpu->rb.entries[cpu->writeback_iu.latch.reg_id].phy_address].z_flag = cpu->writeback_iu.latch.z_flag;
-				cpu->phys_regs[cpu->rb.entries[cpu->writeback_iu.latch.reg_id].phy_address].p_flag = cpu->writeback_iu.latch.p_flag;
-				cpu->phys_regs[cpu->rb.entries[cpu->writeback_iu.latch.reg_id].phy_address].status = VALID;
-				cpu->phys_regs[cpu->rb.entries[cpu->writeback_iu.latch.reg_id].phy_address].wbv.BYTE = 0;
+				cpu->phys_regs[cpu->rb.entries[stage->latch.reg_id].phy_address].value  = stage->latch.data;
+				cpu->phys_regs[cpu->rb.entries[stage->latch.reg_id].phy_address].z_flag = stage->latch.z_flag;
+				cpu->phys_regs[cpu->rb.entries[stage->latch.reg_id].phy_address].p_flag = stage->latch.p_flag;
+				cpu->phys_regs[cpu->rb.entries[stage->latch.reg_id].phy_address].status = VALID;
+				cpu->phys_regs[cpu->rb.entries[stage->latch.reg_id].phy_address].wbv.BYTE = 0;
 				for(int i = 0; i < IQ_SIZE; i++)
 				{
 					if(cpu->iq.entries[i].al == ALLOCATED)
 					{
-						if(cpu->iq.entries[i].src1_ready == INVALID && cpu->iq.entries[i].src1_tag == cpu->writeback_iu.latch.reg_id)
+						if(cpu->iq.entries[i].src1_ready == INVALID && cpu->iq.entries[i].src1_tag == stage->latch.reg_id)
 						{
 							cpu->iq.entries[i].src1_ready = VALID;
-							cpu->iq.entries[i].src1_value = cpu->writeback_iu.latch.data;
-							cpu->iq.entries[i].z_flag = cpu->writeback_iu.latch.z_flag;
-							cpu->iq.entries[i].p_flag = cpu->writeback_iu.latch.p_flag;
+							cpu->iq.entries[i].src1_value = stage->latch.data;
+							cpu->iq.entries[i].z_flag = stage->latch.z_flag;
+							cpu->iq.entries[i].p_flag = stage->latch.p_flag;
 						}
-						if(cpu->iq.entries[i].src2_ready == INVALID && cpu->iq.entries[i].src2_tag == cpu->writeback_iu.latch.reg_id)
+						if(cpu->iq.entries[i].src2_ready == INVALID && cpu->iq.entries[i].src2_tag == stage->latch.reg_id)
 						{
 							cpu->iq.entries[i].src2_ready = VALID;
-							cpu->iq.entries[i].src2_value = cpu->writeback_iu.latch.data;
+							cpu->iq.entries[i].src2_value = stage->latch.data;
 						}
 					}
 				}
@@ -3114,128 +5539,59 @@ writeback_iu(APEX_CPU *cpu)
 				{
 					if(cpu->lsq.entries[i].al == ALLOCATED)
 					{
-						if(cpu->lsq.entries[i].data_ready == INVALID && cpu->lsq.entries[i].src1_tag == cpu->writeback_iu.latch.reg_id)
+						if(cpu->lsq.entries[i].data_ready == INVALID && cpu->lsq.entries[i].src1_tag == stage->latch.reg_id)
 						{
 							cpu->lsq.entries[i].data_ready = VALID;
-							cpu->lsq.entries[i].src1_value = cpu->writeback_iu.latch.data;
+							cpu->lsq.entries[i].src1_value = stage->latch.data;
 						}
 					}
 				}
-				cpu->rb.entries[cpu->writeback_iu.latch.reg_id].status = VALID;
-				cpu->rb.entries[cpu->writeback_iu.latch.reg_id].result = cpu->writeback_iu.latch.data;
+				cpu->rb.entries[stage->latch.reg_id].status = VALID;
+				cpu->rb.entries[stage->latch.reg_id].result = stage->latch.data;
 		    }
-			else if(cpu->writeback_iu.iq_entry.fu_type == OPCODE_LOAD ||
-				    cpu->writeback_iu.iq_entry.fu_type == OPCODE_STORE)
-			{
-				printf("IU WB: lsq_id = %d\n", cpu->writeback_iu.iq_entry.lsq_id);
-				for(int i = 0; i < LSQ_SIZE; i++)
-				{
-					if(cpu->lsq.entries[i].al == ALLOCATED && i == cpu->writeback_iu.iq_entry.lsq_id)
-					{
-						printf("IU WB: Match Found = %d \n", i);
-						cpu->lsq.entries[i].mem_valid = VALID;
-						cpu->lsq.entries[i].mem_address = cpu->writeback_iu.latch.data;
-						break;
-					}
-				}
-			}
 			else
 			{
-				cpu->rb.entries[cpu->writeback_iu.latch.reg_id].status = VALID;
-			}
-		}
-		cpu->writeback_iu.has_insn = 0;
-	}
-}
-
-/*
- * Function to Writeback/Forward MU results
- *
- * Note: You are free to edit this function according to your implementation
- */
-static void
-writeback_mu(APEX_CPU *cpu)
-{
-	cpu->debug_writeback_mu = cpu->writeback_mu;
-	if(cpu->writeback_mu.has_insn == 1)
-	{
-		if(cpu->writeback_mu.latch.ready == 1)
-		{
-			cpu->writeback_mu.latch.ready = 0;
-
-			cpu->phys_regs[cpu->rb.entries[cpu->writeback_mu.latch.reg_id].phy_address].value  = cpu->writeback_mu.latch.data;
-			cpu->phys_regs[cpu->rb.entries[cpu->writeback_mu.latch.reg_id].phy_address].z_flag = cpu->writeback_mu.latch.z_flag;
-			cpu->phys_regs[cpu->rb.entries[cpu->writeback_mu.latch.reg_id].phy_address].p_flag = cpu->writeback_mu.latch.p_flag;
-			cpu->phys_regs[cpu->rb.entries[cpu->writeback_mu.latch.reg_id].phy_address].status = VALID;
-			cpu->phys_regs[cpu->rb.entries[cpu->writeback_mu.latch.reg_id].phy_address].wbv.BYTE = 0;
-
-			for(int i = 0; i < IQ_SIZE; i++)
-			{
-				if(cpu->iq.entries[i].al == ALLOCATED)
-				{
-					if(cpu->iq.entries[i].src1_ready == INVALID && cpu->iq.entries[i].src1_tag == cpu->writeback_mu.latch.reg_id)
-					{
-						cpu->iq.entries[i].src1_ready = VALID;
-						cpu->iq.entries[i].src1_value = cpu->writeback_mu.latch.data;
-					}
-					if(cpu->iq.entries[i].src2_ready == INVALID && cpu->iq.entries[i].src2_tag == cpu->writeback_mu.latch.reg_id)
-					{
-						cpu->iq.entries[i].src2_ready = VALID;
-						cpu->iq.entries[i].src2_value = cpu->writeback_mu.latch.data;
-					}
-				}
-			}
-			for(int i = 0; i < LSQ_SIZE; i++)
-			{
-				if(cpu->lsq.entries[i].al == ALLOCATED)
-				{
-					if(cpu->lsq.entries[i].data_ready == INVALID && cpu->lsq.entries[i].src1_tag == cpu->writeback_mu.latch.reg_id)
-					{
-						cpu->lsq.entries[i].data_ready = VALID;
-						cpu->lsq.entries[i].src1_value = cpu->writeback_mu.latch.data;
-					}
-				}
+				cpu->rb.entries[stage->latch.reg_id].status = VALID;
 			}
-			cpu->rb.entries[cpu->writeback_mu.latch.reg_id].status = VALID;
-			cpu->rb.entries[cpu->writeback_mu.latch.reg_id].result = cpu->writeback_mu.latch.data;
 		}
-		cpu->writeback_mu.has_insn = 0;
+		stage->has_insn = 0;
 	}
 }
 
 /*
- * Function to Writeback/Forward Load/Store FU results
+ * Function to Writeback/Forward the results of a Load/Store pipe
  *
  * Note: You are free to edit this function according to your implementation
  */
 static void
-writeback_load(APEX_CPU *cpu)
+writeback_load(APEX_CPU *cpu, int p)
 {
-	cpu->debug_writeback_load = cpu->writeback_load;
-	if(cpu->writeback_load.has_insn == 1)
+	MEM_FU_Stage *stage = &cpu->writeback_load[p];
+	cpu->debug_writeback_load[p] = *stage;
+	if(stage->has_insn == 1)
 	{
-		if(cpu->writeback_load.latch.ready == 1)
+		if(stage->latch.ready == 1)
 		{
-			cpu->writeback_load.latch.ready = 0;
+			stage->latch.ready = 0;
 
-			if(cpu->writeback_load.lsq_entry.ls_bit == 0)
+			if(stage->lsq_entry.ls_bit == 0)
 			{
-				cpu->phys_regs[cpu->rb.entries[cpu->writeback_load.latch.reg_id].phy_address].value  = cpu->writeback_load.latch.data;
-				cpu->phys_regs[cpu->rb.entries[cpu->writeback_load.latch.reg_id].phy_address].status = VALID;
+				cpu->phys_regs[cpu->rb.entries[stage->latch.reg_id].phy_address].value  = stage->latch.data;
+				cpu->phys_regs[cpu->rb.entries[stage->latch.reg_id].phy_address].status = VALID;
 
 				for(int i = 0; i < IQ_SIZE; i++)
 				{
 					if(cpu->iq.entries[i].al == ALLOCATED)
 					{
-						if(cpu->iq.entries[i].src1_ready == INVALID && cpu->iq.entries[i].src1_tag == cpu->execute_load_store.latch.reg_id)
+						if(cpu->iq.entries[i].src1_ready == INVALID && cpu->iq.entries[i].src1_tag == stage->latch.reg_id)
 						{
 							cpu->iq.entries[i].src1_ready = VALID;
-							cpu->iq.entries[i].src1_value = cpu->execute_load_store.latch.data;
+							cpu->iq.entries[i].src1_value = stage->latch.data;
 						}
-						if(cpu->iq.entries[i].src2_ready == INVALID && cpu->iq.entries[i].src2_tag == cpu->execute_load_store.latch.reg_id)
+						if(cpu->iq.entries[i].src2_ready == INVALID && cpu->iq.entries[i].src2_tag == stage->latch.reg_id)
 						{
 							cpu->iq.entries[i].src2_ready = VALID;
-							cpu->iq.entries[i].src2_value = cpu->execute_load_store.latch.data;
+							cpu->iq.entries[i].src2_value = stage->latch.data;
 						}
 					}
 				}
@@ -3243,21 +5599,45 @@ writeback_load(APEX_CPU *cpu)
 				{
 					if(cpu->lsq.entries[i].al == ALLOCATED)
 					{
-						if(cpu->lsq.entries[i].data_ready == INVALID && cpu->lsq.entries[i].src1_tag == cpu->execute_load_store.latch.reg_id)
+						if(cpu->lsq.entries[i].data_ready == INVALID && cpu->lsq.entries[i].src1_tag == stage->latch.reg_id)
 						{
 							cpu->lsq.entries[i].data_ready = VALID;
-							cpu->lsq.entries[i].src1_value = cpu->execute_load_store.latch.data;
+							cpu->lsq.entries[i].src1_value = stage->latch.data;
 						}
 					}
 				}
 			}
 
-			cpu->rb.entries[cpu->writeback_load.latch.reg_id].status = VALID;
-			cpu->rb.entries[cpu->writeback_load.latch.reg_id].sval_valid = VALID;
-			cpu->rb.entries[cpu->writeback_load.latch.reg_id].svalue = cpu->writeback_load.lsq_entry.mem_address;
-			cpu->rb.entries[cpu->writeback_load.latch.reg_id].result = cpu->writeback_load.latch.data;
+			cpu->rb.entries[stage->latch.reg_id].status = VALID;
+			cpu->rb.entries[stage->latch.reg_id].poisoned = stage->lsq_entry.poisoned;
+			if(stage->lsq_entry.poisoned)
+			{
+				cpu->runahead.poisoned++;
+			}
+			cpu->rb.entries[stage->latch.reg_id].sval_valid = VALID;
+			cpu->rb.entries[stage->latch.reg_id].svalue = stage->lsq_entry.mem_address;
+			cpu->rb.entries[stage->latch.reg_id].result = stage->latch.data;
+
+			if(LOAD_VALUE_PREDICTION && stage->lsq_entry.ls_bit == 0 && !stage->lsq_entry.poisoned)
+			{
+				train_load_value_predictor(cpu, stage->lsq_entry.pc, stage->latch.data);
+				if(stage->lsq_entry.value_predicted && stage->latch.data == stage->lsq_entry.predicted_value)
+				{
+					cpu->value_predictor.correct++;
+				}
+				else if(stage->lsq_entry.value_predicted)
+				{
+					/* Younger instructions may have used the wrong value,
+					 * squash them and refetch after the load */
+					int size = cpu->rb.size;
+					cpu->value_predictor.mispredicted++;
+					stage->has_insn = 0;
+					flush_instructions_after_branch(cpu, stage->lsq_entry.rob_id, stage->lsq_entry.pc + INSTRUCTION_SIZE);
+					cpu->value_predictor.squashed += size - cpu->rb.size;
+				}
+			}
 		}
-		cpu->writeback_load.has_insn = 0;
+		stage->has_insn = 0;
 	}
 }
 
@@ -3267,73 +5647,39 @@ writeback_load(APEX_CPU *cpu)
  * Note: You are free to edit this function according to your implementation
  */
 static void
-writeback_bu(APEX_CPU *cpu)
+writeback_bu(APEX_CPU *cpu, int b)
 {
-	cpu->debug_writeback_bu = cpu->writeback_bu;
-	if(cpu->writeback_bu.has_insn == 1)
+	FU_Stage *stage = &cpu->writeback_bu[b];
+
+	cpu->debug_writeback_bu[b] = *stage;
+	if(stage->has_insn == 1)
 	{
-		if(cpu->writeback_bu.latch.ready == 1)
+		if(stage->latch.ready == 1)
 		{
-			cpu->writeback_bu.latch.ready = 0;
-			switch(cpu->writeback_bu.iq_entry.fu_type)
+			stage->latch.ready = 0;
+			/* Redirects were made in execute_bu, only the JALR link
+			 * register is written back */
+			switch(stage->iq_entry.fu_type)
 			{
-				case OPCODE_BZ:
-				case OPCODE_BNZ:
-				case OPCODE_BP:
-				case OPCODE_BNP:
-				{
-					if(cpu->writeback_bu.change_control == 1)
-					{
-						flush_instructions_after_branch(cpu, cpu->writeback_bu.iq_entry.cycle, cpu->btb.entries[cpu->writeback_bu.iq_entry.btb_id].target);
-						//cpu->fetch_from_next_cycle = TRUE;
-					}
-					if(cpu->writeback_bu.misprediction == 1)
-					{
-						// Recover from mis prediction
-						flush_instructions_after_branch(cpu, cpu->writeback_bu.iq_entry.cycle, cpu->writeback_bu.iq_entry.pc + INSTRUCTION_SIZE);
-						//cpu->fetch_from_next_cycle = TRUE;
-						cpu->misprediction = 1;
-						cpu->writeback_bu.misprediction = 0;
-						cpu->misprediction_clock = cpu->writeback_bu.iq_entry.cycle;
-					}
-					break;
-				}
-
-				case OPCODE_JUMP:
-				{
-					if(cpu->writeback_bu.change_control == 1)
-					{
-						flush_instructions_after_branch(cpu, cpu->writeback_bu.iq_entry.cycle, cpu->btb.entries[cpu->writeback_bu.iq_entry.btb_id].target);
-						//cpu->fetch_from_next_cycle = TRUE;
-					}
-					break;
-				}
-
 				case OPCODE_JALR:
 				{
+					cpu->phys_regs[cpu->rb.entries[stage->latch.reg_id].phy_address].value  = stage->latch.data;
+					cpu->phys_regs[cpu->rb.entries[stage->latch.reg_id].phy_address].status = VALID;
 
-					if(cpu->writeback_bu.change_control == 1)
-					{
-						flush_instructions_after_branch(cpu, cpu->writeback_bu.iq_entry.cycle, cpu->btb.entries[cpu->writeback_bu.iq_entry.btb_id].target);
-					}
-
-					cpu->phys_regs[cpu->rb.entries[cpu->writeback_bu.latch.reg_id].phy_address].value  = cpu->writeback_bu.latch.data;
-					cpu->phys_regs[cpu->rb.entries[cpu->writeback_bu.latch.reg_id].phy_address].status = VALID;
-
-					cpu->rb.entries[cpu->writeback_bu.latch.reg_id].result = cpu->writeback_bu.latch.data;
+					cpu->rb.entries[stage->latch.reg_id].result = stage->latch.data;
 					for(int i = 0; i < IQ_SIZE; i++)
 					{
 						if(cpu->iq.entries[i].al == ALLOCATED)
 						{
-							if(cpu->iq.entries[i].src1_ready == INVALID && cpu->iq.entries[i].src1_tag == cpu->writeback_bu.latch.reg_id)
+							if(cpu->iq.entries[i].src1_ready == INVALID && cpu->iq.entries[i].src1_tag == stage->latch.reg_id)
 							{
 								cpu->iq.entries[i].src1_ready = VALID;
-								cpu->iq.entries[i].src1_value = cpu->writeback_bu.latch.data;
+								cpu->iq.entries[i].src1_value = stage->latch.data;
 							}
-							if(cpu->iq.entries[i].src2_ready == INVALID && cpu->iq.entries[i].src2_tag == cpu->writeback_bu.latch.reg_id)
+							if(cpu->iq.entries[i].src2_ready == INVALID && cpu->iq.entries[i].src2_tag == stage->latch.reg_id)
 							{
 								cpu->iq.entries[i].src2_ready = VALID;
-								cpu->iq.entries[i].src2_value = cpu->writeback_bu.latch.data;
+								cpu->iq.entries[i].src2_value = stage->latch.data;
 							}
 						}
 					}
@@ -3341,25 +5687,20 @@ writeback_bu(APEX_CPU *cpu)
 					{
 						if(cpu->lsq.entries[i].al == ALLOCATED)
 						{
-							if(cpu->lsq.entries[i].data_ready == INVALID && cpu->lsq.entries[i].src1_tag == cpu->writeback_bu.latch.reg_id)
+							if(cpu->lsq.entries[i].data_ready == INVALID && cpu->lsq.entries[i].src1_tag == stage->latch.reg_id)
 							{
 								cpu->lsq.entries[i].data_ready = VALID;
-								cpu->lsq.entries[i].src1_value = cpu->writeback_bu.latch.data;
+								cpu->lsq.entries[i].src1_value = stage->latch.data;
 							}
 						}
 					}
 					break;
 				}
-
-				case OPCODE_RET:
-				{
-					break;
-				}
 			}
 		}
-		cpu->debug_writeback_bu = cpu->writeback_bu;
-		cpu->rb.entries[cpu->writeback_bu.latch.reg_id].status = VALID;
-		cpu->writeback_bu.has_insn = 0;
+		cpu->debug_writeback_bu[b] = *stage;
+		cpu->rb.entries[stage->latch.reg_id].status = VALID;
+		stage->has_insn = 0;
 	}
 }
 
@@ -3371,10 +5712,18 @@ writeback_bu(APEX_CPU *cpu)
 static void
 APEX_writeback(APEX_CPU *cpu)
 {
-	writeback_bu(cpu);
-	writeback_mu(cpu);
-	writeback_load(cpu);
-	writeback_iu(cpu);
+	for(int b = 0; b < NUM_BU_UNITS; b++)
+	{
+		writeback_bu(cpu, b);
+	}
+	for(int u = 0; u < NUM_FUS; u++)
+	{
+		writeback_fu(cpu, u);
+	}
+	for(int p = 0; p < NUM_LS_PIPES; p++)
+	{
+		writeback_load(cpu, p);
+	}
 }
 
 /*
@@ -3404,7 +5753,7 @@ APEX_cpu_init(const char *commands[])
     memset(cpu->phys_regs, 0, sizeof(PHYS_REG) * PHYS_REG_FILE_SIZE);
     memset(cpu->arch_regs, 0, sizeof(ARCH_REG) * REG_FILE_SIZE);
     //memset(cpu->rename_table, -1, sizeof(RENAME_TABLE) * REG_FILE_SIZE);
-    for(int i = 0; i < PHYS_REG_FILE_SIZE; i++)
+    for(int i = 0; i < REG_FILE_SIZE; i++)
     {
     	cpu->rename_table[i].slot_id = i;
     	cpu->rename_table[i].src_bit = 0;
@@ -3473,18 +5822,83 @@ APEX_cpu_init(const char *commands[])
     cpu->btb.num_of_entries = BTB_SIZE;
     cpu->btb.size = 0;
     cpu->btb.entries = calloc(BTB_SIZE, sizeof(BTB_Entry));
-    if(!cpu->btb.entries)
+    cpu->btb.shadow.prev = calloc(cpu->code_memory_size, sizeof(int));
+    cpu->btb.shadow.next = calloc(cpu->code_memory_size, sizeof(int));
+    cpu->btb.shadow.held = calloc(cpu->code_memory_size, sizeof(unsigned char));
+    cpu->btb.shadow.seen = calloc(cpu->code_memory_size, sizeof(unsigned char));
+    cpu->bpred.penalties = calloc(cpu->code_memory_size, sizeof(BRANCH_PENALTY));
+    if(!cpu->btb.entries || !cpu->btb.shadow.prev || !cpu->btb.shadow.next ||
+       !cpu->btb.shadow.held || !cpu->btb.shadow.seen || !cpu->bpred.penalties)
     {
         free(cpu);
         return NULL;
     }
-    memset(cpu->btb.entries, 0, BTB_SIZE * sizeof(BTB_Entry));
+    cpu->btb.shadow.head = -1;
+    cpu->btb.shadow.tail = -1;
     /* To start fetch stage */
 
     cpu->misprediction = 0;
     cpu->misprediction_clock = -1;
 
-    cpu->fetch.has_insn = TRUE;
+    /* Counters start weakly not taken, TAGE tables empty */
+    cpu->bpred.type = BRANCH_PREDICTOR;
+    memset(cpu->bpred.bimodal, 1, sizeof(cpu->bpred.bimodal));
+    memset(cpu->bpred.gshare, 1, sizeof(cpu->bpred.gshare));
+    memset(cpu->bpred.chooser, 1, sizeof(cpu->bpred.chooser));
+    for(int t = 0; t < TAGE_NUM_TABLES; t++)
+    {
+        int length = TAGE_MIN_HISTORY << t;
+        cpu->bpred.tage_history_length[t] = length < 64 ? length : 64;
+        for(int i = 0; i < TAGE_TABLE_SIZE; i++)
+        {
+            cpu->bpred.tage[t][i].tag = -1;
+        }
+    }
+
+    store_set_clear(cpu);
+
+    for(int u = 0; u < NUM_FUS; u++)
+    {
+        FU_Unit *unit = &cpu->fu_pool[u];
+        if(u < NUM_IU_UNITS)
+        {
+            unit->type = "IU";
+            unit->index = u;
+            unit->opcodes = IU_OPCODES;
+            unit->latency = IU_LATENCY;
+            unit->pipelined = IU_PIPELINED;
+        }
+        else if(u < NUM_IU_UNITS + NUM_MU_UNITS)
+        {
+            unit->type = "MU";
+            unit->index = u - NUM_IU_UNITS;
+            unit->opcodes = MU_OPCODES;
+            unit->latency = MU_LATENCY;
+            unit->pipelined = MU_PIPELINED;
+        }
+        else
+        {
+            unit->type = "DV";
+            unit->index = u - NUM_IU_UNITS - NUM_MU_UNITS;
+            unit->opcodes = DIV_OPCODES;
+            unit->latency = DIV_LATENCY;
+            unit->pipelined = FALSE;
+        }
+        unit->slots = unit->pipelined ? unit->latency : 1;
+    }
+
+    cpu->prefetcher.type = DATA_PREFETCHER;
+    cpu->prefetcher.degree = PREFETCH_DEGREE;
+
+    if(MEM_TRACE)
+    {
+        cpu->mem_trace.file = fopen(MEM_TRACE_FILE, "wb");
+        if(!cpu->mem_trace.file)
+        {
+            fprintf(stderr, "APEX_Error: Unable to open memory trace file %s\n", MEM_TRACE_FILE);
+        }
+    }
+
     return cpu;
 }
 
@@ -3550,6 +5964,7 @@ APEX_cpu_run(APEX_CPU *cpu)
                 print_rob(cpu);
                 print_data_memory(cpu);
             }
+            print_simulation_stats(cpu);
             printf("\nAPEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock+1, cpu->insn_completed);
             break;
         }
@@ -3566,6 +5981,7 @@ APEX_cpu_run(APEX_CPU *cpu)
 				print_lsq(cpu);
 				print_rob(cpu);
 				print_data_memory(cpu);
+				print_simulation_stats(cpu);
 				printf("\nAPEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
 				break;
 			}
@@ -3583,6 +5999,17 @@ APEX_cpu_run(APEX_CPU *cpu)
 void
 APEX_cpu_stop(APEX_CPU *cpu)
 {
+    if(cpu->mem_trace.file)
+    {
+        mem_trace_flush(cpu);
+        fclose(cpu->mem_trace.file);
+    }
+    free(cpu->btb.entries);
+    free(cpu->btb.shadow.prev);
+    free(cpu->btb.shadow.next);
+    free(cpu->btb.shadow.held);
+    free(cpu->btb.shadow.seen);
+    free(cpu->bpred.penalties);
     free(cpu->code_memory);
     free(cpu);
 }
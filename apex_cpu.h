@@ -9,6 +9,7 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 
+#include <stdio.h>
 #include "apex_macros.h"
 
 typedef unsigned char uint8;
@@ -19,12 +20,11 @@ typedef enum PIPELINE_STAGES {
     FETCH = 0,
     DECODE_RENAME1,
     RENAME2_DISPATCH,
-	EXECUTE_IU,
-	EXECUTE_MU,
+	EXECUTE_FU,
 	EXECUTE_BU,
+	EXECUTE_AGU,
 	EXECUTE_LOAD_STORE,
-    WRITEBACK_IU,
-	WRITEBACK_MU,
+    WRITEBACK_FU,
 	WRITEBACK_BU,
 	WRITEBACK_LOAD
 } PIPELINE_STAGES;
@@ -61,6 +61,13 @@ typedef enum LOAD_STORE_BIT {
     STORE
 } LOAD_STORE_BIT;
 
+/* Enumeration for loop stream buffer states */
+typedef enum LOOP_BUFFER_STATE {
+    LOOP_IDLE = 0,
+    LOOP_CAPTURING,
+    LOOP_ACTIVE
+} LOOP_BUFFER_STATE;
+
 /* Enumeration for different APEX CPU commands */
 typedef enum CPU_COMMAND_TYPE {
     SIMULATE = 0,
@@ -90,6 +97,7 @@ typedef struct ARCH_REG {
     int value;
     int z_flag;
     int p_flag;
+    int poisoned;        /* Written by a runahead instruction with an unknown result */
 } ARCH_REG;
 
 /* Bit field for waiting bit vector of pyhsical registers*/
@@ -132,6 +140,17 @@ typedef struct LSQ_Entry {
     int rd;
 	int pc;
 	int rob_id;
+	int issued;          /* Sent to the LSU, slot is kept until it reaches the head */
+	int speculative;     /* Load issued past an older store with unknown address */
+	int forwarded;       /* Load takes src1_value from an older store */
+	int sb_forwarded;    /* ... which is already in the store buffer */
+	int ss_lsq_id;       /* Store the store set predictor makes it wait for */
+	int ss_rob_id;
+	int ss_waited;       /* Load was held back by the store set predictor */
+	int poisoned;        /* Runahead access whose address/data is unknown */
+	int bad_address;     /* Address outside data memory, only on the wrong path */
+	int value_predicted; /* Dependents were given predicted_value at dispatch */
+	int predicted_value;
 	unsigned int cycle;
 	char opcode_str[128];
 } LSQ_Entry;
@@ -143,8 +162,29 @@ typedef struct LSQ {
     int rear;
     int size;
     LSQ_Entry *entries;
+    int ooo_loads;
+    int speculative_loads;
+    int violations;
+    int forwarded_loads;
+    int multi_issue_cycles;
+    int agu_addresses;
+    int early_store_addresses;
 } LSQ;
 
+/* Prediction the branch prediction unit made for an instruction, the
+ * branch unit checks it and flushes repair the global history and the
+ * return address stack from it */
+typedef struct BRANCH_PREDICTION
+{
+	int direction;                              /* Output of the direction predictor */
+	int taken;                                  /* Direction fetch followed, taken needs a BTB target */
+	int target;                                 /* PC fetched next */
+	int indirect_hit;                           /* Target came from the indirect predictor */
+	unsigned long long history;                 /* Global history before the branch */
+	int ras_top;                                /* Return address stack top before the branch */
+	int ras_value;                              /* and the entry it pointed to */
+} BRANCH_PREDICTION;
+
 /* Format of an IQ Entry */
 typedef struct IQ_Entry {
 	ALLOCATION_STATUS al;
@@ -164,7 +204,7 @@ typedef struct IQ_Entry {
     int p_flag;
     int lsq_id;
     int rob_id;
-    int btb_id;
+    BRANCH_PREDICTION prediction;
 	int pc;
 	unsigned int cycle;
 	char opcode_str[128];
@@ -206,7 +246,8 @@ typedef struct CPU_Stage
     int rs2_value;
     int p2_value;
     int has_insn;
-    int btb_id;
+    BRANCH_PREDICTION prediction;
+    int renamed;                                /* Destination allocated in decode/rename1 */
 } CPU_Stage;
 
 /* Model of FU stage latch */
@@ -218,6 +259,7 @@ typedef struct FU_Stage
 	int delay;
 	int change_control;
 	int misprediction;
+	int target;                                 /* Resolved next PC of a control transfer */
 	IQ_Entry iq_entry;
 	DATA_FORWARDING_LATCH latch;
 } FU_Stage;
@@ -252,6 +294,11 @@ typedef struct ROB_Entry
 	int excodes;
 	int status;
 	int itype;
+	int poisoned;
+	int taken;                                  /* Outcome of a conditional branch */
+	int mem_address;                            /* Data memory word of a LOAD, set when it issues */
+	BRANCH_PREDICTION prediction;               /* Checkpoint of a control transfer, for flushes of older entries */
+	RENAME_TABLE rename_checkpoint[REG_FILE_SIZE];  /* Taken at dispatch by branches and value predicted loads */
 
 }ROB_Entry;
 
@@ -262,6 +309,8 @@ typedef struct ROB
 	int rear;
 	int size;
 	ROB_Entry *entries;
+	int commit_cycles;                          /* Cycles retiring at least one entry */
+	int full_commit_cycles;                     /* Cycles retiring COMMIT_WIDTH entries */
 } ROB;
 
 typedef struct BTB_Entry
@@ -269,19 +318,388 @@ typedef struct BTB_Entry
 	int al;
 	int tag;
 	int type;
-	int resolved;
 	int target;
-	int history;
-	int prediction;
+	unsigned int lru;
 }BTB_Entry;
 
+/* Fully associative LRU btb of the same size, only kept to tell
+ * capacity misses from conflict misses. PCs are linked by code memory
+ * index, the most recently used at the head */
+typedef struct BTB_SHADOW
+{
+	int *prev;
+	int *next;
+	unsigned char *held;
+	unsigned char *seen;                        /* PC was ever allocated */
+	int head;
+	int tail;
+	int size;
+} BTB_SHADOW;
+
 typedef struct BTB
 {
 	int num_of_entries;
 	int size;
-	BTB_Entry *entries;
+	BTB_Entry *entries;                         /* BTB_SETS sets of BTB_WAYS ways */
+	BTB_SHADOW shadow;
+	int lookups;
+	int hits;
+	int compulsory_misses;
+	int capacity_misses;                        /* Would miss a fully associative btb too */
+	int conflict_misses;
+	int decode_redirects;                       /* Taken branches missing in the btb redirected at decode */
 } BTB;
 
+/* Return address stack, circular so that a push on a full stack
+ * overwrites the oldest entry */
+typedef struct RAS
+{
+	int entries[RAS_SIZE];
+	int top;
+} RAS;
+
+/* Entry of the indirect target predictor */
+typedef struct INDIRECT_Entry
+{
+	int valid;
+	int tag;                                    /* PC of the JUMP/JALR */
+	int target;
+} INDIRECT_Entry;
+
+/* Targets of RET, JUMP and JALR. The speculative return address stack
+ * is repaired from the top saved by the branch causing a flush */
+typedef struct TARGET_PREDICTOR
+{
+	RAS ras;
+	RAS retired_ras;                            /* Pushes and pops of the retired instructions */
+	INDIRECT_Entry indirect[INDIRECT_TABLE_SIZE];
+	int returns;
+	int returns_correct;
+	int jumps;
+	int indirect_hits;
+	int jumps_correct;
+} TARGET_PREDICTOR;
+
+/* Enumeration for different conditional branch predictors */
+typedef enum BRANCH_PREDICTOR_TYPE {
+    BP_BIMODAL = PREDICTOR_BIMODAL,
+    BP_GSHARE = PREDICTOR_GSHARE,
+    BP_TOURNAMENT = PREDICTOR_TOURNAMENT,
+    BP_TAGE = PREDICTOR_TAGE
+} BRANCH_PREDICTOR_TYPE;
+
+/* Entry of a TAGE tagged table */
+typedef struct TAGE_Entry
+{
+	int tag;
+	int counter;                                /* 3-bit, taken from 4 up */
+	int useful;                                 /* 2-bit */
+} TAGE_Entry;
+
+/* Redirects caused by one control transfer and the cycles they cost */
+typedef struct BRANCH_PENALTY
+{
+	int redirects;
+	unsigned int cycles;                        /* Dispatch to redirect plus BRANCH_REDIRECT_PENALTY */
+} BRANCH_PENALTY;
+
+/* Conditional branch direction predictor. Fetch shifts every
+ * prediction into the speculative global history, a flush restores it
+ * from the checkpoint of the branch that caused it */
+typedef struct DIRECTION_PREDICTOR
+{
+	BRANCH_PREDICTOR_TYPE type;
+	unsigned long long history;                 /* Speculative global history, newest outcome in bit 0 */
+	unsigned long long retired_history;         /* Outcomes of the retired branches */
+	unsigned char bimodal[BP_TABLE_SIZE];       /* 2-bit counters, also the TAGE base predictor */
+	unsigned char gshare[BP_TABLE_SIZE];
+	unsigned char chooser[BP_TABLE_SIZE];       /* Tournament, gshare from 2 up */
+	TAGE_Entry tage[TAGE_NUM_TABLES][TAGE_TABLE_SIZE];
+	int tage_history_length[TAGE_NUM_TABLES];
+	unsigned int tage_updates;
+	int branches;
+	int mispredicted;
+	int redirects;                              /* Flushes by a wrong next PC of any control transfer */
+	BRANCH_PENALTY *penalties;                  /* Indexed by code memory index */
+} DIRECTION_PREDICTOR;
+
+/* Tag store of a data cache line, data itself stays in data_memory */
+typedef struct DCACHE_Line
+{
+	int valid;
+	int tag;
+	int prefetched;
+	unsigned int lru;
+	unsigned int ready_cycle;
+} DCACHE_Line;
+
+typedef struct DCACHE
+{
+	DCACHE_Line lines[DCACHE_SETS][DCACHE_WAYS];
+	int accesses;
+	int hits;
+	int misses;
+	int bank_conflicts;
+} DCACHE;
+
+/* LRU stacks of every set of every power of two set count, a hit at
+ * stack depth d is a hit in any cache of that set count with more
+ * than d ways */
+typedef struct STACK_DISTANCE
+{
+	int stacks[SWEEP_SET_CONFIGS][SWEEP_MAX_SETS][SWEEP_MAX_WAYS];
+	int depth[SWEEP_SET_CONFIGS][SWEEP_MAX_SETS];
+	unsigned int hits[SWEEP_SET_CONFIGS][SWEEP_MAX_WAYS];
+	unsigned int accesses;
+} STACK_DISTANCE;
+
+/* One memory trace record as written to MEM_TRACE_FILE, address is
+ * the data memory word with MEM_TRACE_STORE set for stores. Cycle is
+ * when a load retired or a store started to drain */
+typedef struct MEM_TRACE_Record
+{
+	unsigned int cycle;
+	unsigned int pc;
+	unsigned int address;
+} MEM_TRACE_Record;
+
+/* Buffered writer of the memory trace */
+typedef struct MEM_TRACE_WRITER
+{
+	FILE *file;
+	MEM_TRACE_Record records[MEM_TRACE_BUFFER_SIZE];
+	int count;
+	unsigned int written;
+} MEM_TRACE_WRITER;
+
+/* Configuration and usage of one unit of the functional unit pool */
+typedef struct FU_Unit
+{
+	const char *type;                           /* "IU", "MU" or "DV" */
+	int index;                                  /* Unit number within its type */
+	unsigned int opcodes;                       /* FU_OPCODE() mask of the opcodes it executes */
+	int latency;                                /* Worst case for a divider with early out */
+	int pipelined;
+	int slots;                                  /* Instructions in flight, latency if pipelined */
+	int issued;
+	unsigned int latency_sum;                   /* Cycles taken by the instructions it started */
+	unsigned int busy_cycles;                   /* Cycles with an instruction in flight */
+	unsigned int blocked_cycles;                /* Cycles a ready instruction waited for a free slot */
+} FU_Unit;
+
+/* Fetch and dispatch group statistics of the front end */
+typedef struct FRONT_END
+{
+	int fetched;
+	int dispatched;
+	int dispatch_cycles;
+	int full_dispatch_cycles;
+	int blocks;                                 /* Fetch blocks predicted */
+	int block_instructions;
+	unsigned int ftq_occupancy;                 /* Sum over cycles of blocks in the FTQ */
+	int ftq_full_cycles;                        /* Cycles prediction waited for a free FTQ entry */
+	unsigned int buffer_occupancy;              /* Sum over cycles of instructions in the fetch buffer */
+	int buffer_full_cycles;                     /* Cycles fetch waited for room in the fetch buffer */
+} FRONT_END;
+
+/* Fetch block predicted by the branch prediction unit, sequential
+ * instructions or a trace, with the prediction made for each of them */
+typedef struct FTQ_Entry
+{
+	int count;
+	int fetched;                                /* Instructions of the block already fetched */
+	int trace;                                  /* Taken branches inside do not end a fetch group */
+	unsigned int ready_cycle;                   /* First cycle fetch may read the block */
+	int pcs[FTQ_BLOCK_SLOTS];
+	BRANCH_PREDICTION predictions[FTQ_BLOCK_SLOTS];
+} FTQ_Entry;
+
+/* Dynamic instruction sequence of the trace cache, tagged by the PC
+ * of its first instruction. Branch outcomes are implied by the PCs */
+typedef struct TRACE_Line
+{
+	int valid;
+	int count;
+	unsigned int lru;
+	int pcs[FRONTEND_WIDTH];
+	int opcodes[FRONTEND_WIDTH];
+} TRACE_Line;
+
+typedef struct TRACE_CACHE_UNIT
+{
+	TRACE_Line lines[TRACE_CACHE_SETS][TRACE_CACHE_WAYS];
+	TRACE_Line fill;                            /* Trace being built at decode */
+	int fill_branches;
+	int fill_next_pc;                           /* PC the last filled instruction was predicted to go to */
+	int lookups;
+	int hits;
+	int instructions;                           /* Instructions predicted from traces */
+	int built;
+} TRACE_CACHE_UNIT;
+
+/* Fetch target queue, circular with the oldest block at head */
+typedef struct FTQ
+{
+	FTQ_Entry entries[FTQ_SIZE];
+	int head;
+	int size;
+	unsigned int resume_cycle;                  /* No prediction before it after a redirect */
+} FTQ;
+
+/* Loop stream buffer, holds the decoded body of a short loop from its
+ * first instruction to the backward branch closing it */
+typedef struct LOOP_STREAM_BUFFER
+{
+	CPU_Stage body[LOOP_BUFFER_SIZE];
+	LOOP_BUFFER_STATE state;
+	int start;                                  /* PC of the first instruction of the loop */
+	int branch_pc;                              /* PC of the branch closing the loop */
+	int size;                                   /* Instructions captured */
+	int next;                                   /* Next instruction to replay */
+	int loops;                                  /* Loops captured */
+	int exits;                                  /* Replays left on a not taken prediction */
+	int replayed;                               /* Instructions decode took from the buffer */
+	int delivered;                              /* Instructions decode took from anywhere */
+} LOOP_STREAM_BUFFER;
+
+/* Fetched instructions waiting for decode, circular with the oldest
+ * at head */
+typedef struct FETCH_BUFFER
+{
+	CPU_Stage entries[FETCH_BUFFER_SIZE];
+	int head;
+	int size;
+} FETCH_BUFFER;
+
+/* Miss status holding register, tracks one outstanding line and
+ * the loads/stores waiting on it in arrival order */
+typedef struct MSHR_Entry
+{
+	int valid;
+	int line;
+	unsigned int ready_cycle;
+	int num_targets;
+	LSQ_Entry targets[MSHR_TARGETS];
+} MSHR_Entry;
+
+typedef struct MSHR
+{
+	MSHR_Entry entries[NUM_MSHRS];
+	int primary_misses;
+	int secondary_misses;
+	int full_stalls;
+	int peak_outstanding;
+	unsigned int outstanding_cycles;
+} MSHR;
+
+/* Store that has left the LSQ, written to memory after it retires */
+typedef struct SB_Entry
+{
+	int committed;
+	int address;
+	int data;
+	int pc;
+	int rob_id;
+} SB_Entry;
+
+typedef struct STORE_BUFFER
+{
+	SB_Entry entries[STORE_BUFFER_SIZE];
+	int front;
+	int size;
+	int draining;
+	unsigned int drain_ready_cycle;
+	int stores;
+	int forwarded_loads;
+	int full_stalls;
+	int peak_occupancy;
+} STORE_BUFFER;
+
+/* Last fetched store of a store set */
+typedef struct LFST_Entry
+{
+	int valid;
+	int lsq_id;
+	int rob_id;
+} LFST_Entry;
+
+/* Store set predictor, the SSIT maps a load/store PC to a store set */
+typedef struct STORE_SET
+{
+	int ssit[SSIT_SIZE];
+	LFST_Entry lfst[LFST_SIZE];
+	int next_ssid;
+	int loads;
+	int waits;
+	int false_dependences;
+} STORE_SET;
+
+/* Load value predictor entry, predicts last_value + stride */
+typedef struct LVP_Entry
+{
+	int valid;
+	int pc;
+	int last_value;
+	int stride;
+	int confidence;
+} LVP_Entry;
+
+typedef struct VALUE_PREDICTOR
+{
+	LVP_Entry table[LVP_TABLE_SIZE];
+	int loads;
+	int predicted;
+	int correct;
+	int mispredicted;
+	int squashed;
+} VALUE_PREDICTOR;
+
+/* Runahead execution, the architectural registers are checkpointed
+ * when a load miss blocks the rob head and restored when it returns */
+typedef struct RUNAHEAD
+{
+	int active;
+	int resuming;        /* Blocking load has not retired since the last episode */
+	int checkpoint_pc;
+	ARCH_REG checkpoint_regs[REG_FILE_SIZE];
+	unsigned int start_cycle;
+	unsigned int exit_cycle;
+	int episodes;
+	unsigned int cycles;
+	int pseudo_retired;
+	int poisoned;
+	int prefetches;
+} RUNAHEAD;
+
+/* Enumeration for different data prefetchers */
+typedef enum PREFETCHER_TYPE {
+    PF_NONE = PREFETCHER_NONE,
+    PF_STRIDE = PREFETCHER_STRIDE,
+    PF_STREAM = PREFETCHER_STREAM
+} PREFETCHER_TYPE;
+
+/* Reference prediction table entry of the stride prefetcher */
+typedef struct STRIDE_PF_Entry
+{
+	int valid;
+	int pc;
+	int last_address;
+	int stride;
+	int confidence;
+} STRIDE_PF_Entry;
+
+typedef struct PREFETCHER
+{
+	PREFETCHER_TYPE type;
+	int degree;
+	STRIDE_PF_Entry stride_table[STRIDE_TABLE_SIZE];
+	int issued;
+	int redundant;
+	int useful;
+	int late;
+	int useless;
+} PREFETCHER;
+
 /* Model of APEX CPU */
 typedef struct APEX_CPU
 {
@@ -292,15 +710,23 @@ typedef struct APEX_CPU
     ARCH_REG arch_regs[REG_FILE_SIZE];          /* Architecture register file */
     PHYS_REG phys_regs[PHYS_REG_FILE_SIZE];     /* Pyhsical register file */
     RENAME_TABLE rename_table[REG_FILE_SIZE];          /* Rename table */
-    ARCH_REG backup_arch_regs[REG_FILE_SIZE];          /* Architecture register file */
-    PHYS_REG backup_phys_regs[PHYS_REG_FILE_SIZE];     /* Pyhsical register file */
-    RENAME_TABLE backup_rename_table[REG_FILE_SIZE];          /* Rename table */
     int misprediction;
     int misprediction_clock;
     IQ iq;
     LSQ lsq;
     ROB rb;
     BTB btb;
+    DIRECTION_PREDICTOR bpred;                  /* Conditional branch direction predictor */
+    TARGET_PREDICTOR tpred;                     /* Return address stack and indirect target predictor */
+    DCACHE dcache;                              /* Data cache tag store */
+    STACK_DISTANCE cache_sweep;                  /* Miss rates of other cache geometries */
+    MEM_TRACE_WRITER mem_trace;                     /* LOAD/STORE reference trace */
+    MSHR mshr;                                  /* Outstanding data cache misses */
+    STORE_BUFFER store_buffer;                  /* Retired stores waiting to write memory */
+    STORE_SET store_set;                        /* Memory dependence predictor */
+    VALUE_PREDICTOR value_predictor;            /* Load value predictor */
+    RUNAHEAD runahead;                          /* Pre-execution past a blocking miss */
+    PREFETCHER prefetcher;                      /* Data prefetcher */
     uint8 stall;                        		/* Stalling status as per scoreboarding */
     uint8 d_stall;                        		/* Stalling status as per scoreboarding */
     int code_memory_size;                       /* Number of instruction in the input file */
@@ -309,32 +735,36 @@ typedef struct APEX_CPU
     int single_step;                            /* Wait for user input after every cycle */
     int zero_flag;                              /* {TRUE, FALSE} Used by BZ and BNZ to branch */
     int positive_flag;                          /* {TRUE, FALSE} Used by BP and BNP to branch */
-    int fetch_from_next_cycle;
+    int fetch_halted;                           /* HALT predicted, no prediction until a redirect */
+    FRONT_END front_end;                        /* Fetch/dispatch group statistics */
+    FTQ ftq;                                    /* Fetch blocks predicted ahead of fetch */
+    FETCH_BUFFER fetch_buffer;                  /* Fetched instructions waiting for decode */
+    LOOP_STREAM_BUFFER loop_buffer;             /* Short loops replayed without fetch */
+    TRACE_CACHE_UNIT trace_cache;               /* Fetch groups spanning taken branches */
+    FU_Unit fu_pool[NUM_FUS];                   /* IU/MUL/DIV functional units */
 
     /* Pipeline stages */
-    CPU_Stage fetch;
-    CPU_Stage decode_rename1;
-    CPU_Stage rename2_dispatch;
-    FU_Stage execute_iu;
-    FU_Stage execute_mu;
-    FU_Stage execute_bu;
-    MEM_FU_Stage execute_load_store;
-    FU_Stage writeback_iu;
-    FU_Stage writeback_mu;
-    FU_Stage writeback_bu;
-    MEM_FU_Stage writeback_load;
+    CPU_Stage fetch[FRONTEND_WIDTH];
+    CPU_Stage decode_rename1[FRONTEND_WIDTH];
+    CPU_Stage rename2_dispatch[FRONTEND_WIDTH];
+    FU_Stage execute_fu[NUM_FUS][FU_MAX_IN_FLIGHT];
+    FU_Stage execute_bu[NUM_BU_UNITS];
+    FU_Stage execute_agu[NUM_AGU_PIPES];
+    MEM_FU_Stage execute_load_store[NUM_LS_PIPES];
+    FU_Stage writeback_fu[NUM_FUS];
+    FU_Stage writeback_bu[NUM_BU_UNITS];
+    MEM_FU_Stage writeback_load[NUM_LS_PIPES];
     /* Debug data */
-    CPU_Stage debug_fetch;
-    CPU_Stage debug_decode_rename1;
-    CPU_Stage debug_rename2_dispatch;
-    FU_Stage debug_execute_iu;
-    FU_Stage debug_execute_mu;
-    FU_Stage debug_execute_bu;
-    MEM_FU_Stage debug_execute_load_store;
-    FU_Stage debug_writeback_iu;
-    FU_Stage debug_writeback_mu;
-    FU_Stage debug_writeback_bu;
-    MEM_FU_Stage debug_writeback_load;
+    CPU_Stage debug_fetch[FRONTEND_WIDTH];
+    CPU_Stage debug_decode_rename1[FRONTEND_WIDTH];
+    CPU_Stage debug_rename2_dispatch[FRONTEND_WIDTH];
+    FU_Stage debug_execute_fu[NUM_FUS][FU_MAX_IN_FLIGHT];
+    FU_Stage debug_execute_bu[NUM_BU_UNITS];
+    FU_Stage debug_execute_agu[NUM_AGU_PIPES];
+    MEM_FU_Stage debug_execute_load_store[NUM_LS_PIPES];
+    FU_Stage debug_writeback_fu[NUM_FUS];
+    FU_Stage debug_writeback_bu[NUM_BU_UNITS];
+    MEM_FU_Stage debug_writeback_load[NUM_LS_PIPES];
 } APEX_CPU;
 
 APEX_Instruction *create_code_memory(const char *filename, int *size);
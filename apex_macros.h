@@ -22,7 +22,363 @@
 #define ROB_SIZE 16
 #define IQ_SIZE	8
 #define LSQ_SIZE 6
-#define BTB_SIZE 30
+
+/* Instructions fetched, renamed and dispatched per cycle. A dispatch
+ * group ends after a control transfer or a value predicted LOAD, so
+ * everything younger is dispatched in a later cycle */
+#ifndef FRONTEND_WIDTH
+#define FRONTEND_WIDTH 1
+#endif
+
+/* Decoupled front end. The branch prediction unit runs ahead of fetch
+ * and queues one predicted fetch block per cycle in a fetch target
+ * queue of FTQ_SIZE blocks. A block holds up to FETCH_BLOCK_SIZE
+ * sequential instructions and ends after a control transfer predicted
+ * taken, it can be fetched BPU_LATENCY cycles after it was predicted.
+ * Fetched instructions wait for decode in a fetch buffer of
+ * FETCH_BUFFER_SIZE instructions */
+#ifndef FTQ_SIZE
+#define FTQ_SIZE 4
+#endif
+#ifndef FETCH_BLOCK_SIZE
+#define FETCH_BLOCK_SIZE (2 * FRONTEND_WIDTH)
+#endif
+#ifndef BPU_LATENCY
+#define BPU_LATENCY 0
+#endif
+#ifndef FETCH_BUFFER_SIZE
+#define FETCH_BUFFER_SIZE (2 * FRONTEND_WIDTH)
+#endif
+
+/* Trace cache, set to 1 to let the branch prediction unit predict a
+ * whole fetch group of FRONTEND_WIDTH instructions across taken
+ * branches in one cycle. Traces are built from the instructions entering
+ * decode, hold at most TRACE_MAX_BRANCHES conditional branches and end
+ * at a JUMP, JALR, RET or HALT. A trace is used when its start PC
+ * matches and the direction predictor agrees with every branch outcome
+ * in it. TRACE_CACHE_SETS must be a power of two */
+#ifndef TRACE_CACHE
+#define TRACE_CACHE 0
+#endif
+#ifndef TRACE_CACHE_SETS
+#define TRACE_CACHE_SETS 16
+#endif
+#ifndef TRACE_CACHE_WAYS
+#define TRACE_CACHE_WAYS 4
+#endif
+#ifndef TRACE_MAX_BRANCHES
+#define TRACE_MAX_BRANCHES 3
+#endif
+
+/* Instructions an FTQ entry holds, a fetch block or a trace */
+#define FTQ_BLOCK_SLOTS (FETCH_BLOCK_SIZE > FRONTEND_WIDTH ? FETCH_BLOCK_SIZE : FRONTEND_WIDTH)
+
+/* Loop stream buffer. A loop closed by a backward conditional branch
+ * predicted taken, with at most LOOP_BUFFER_SIZE instructions and no
+ * other control transfer, is captured as it enters decode and then
+ * replayed into decode/rename1 with prediction and fetch idle until
+ * the branch is predicted not taken or a flush */
+#ifndef LOOP_BUFFER
+#define LOOP_BUFFER 1
+#endif
+#ifndef LOOP_BUFFER_SIZE
+#define LOOP_BUFFER_SIZE 16
+#endif
+
+/* Completed instructions retired from the ROB head per cycle */
+#ifndef COMMIT_WIDTH
+#define COMMIT_WIDTH FRONTEND_WIDTH
+#endif
+
+/* Functional unit pool executing the IU, MUL and DIV instructions.
+ * The first NUM_IU_UNITS units execute the opcodes in IU_OPCODES, the
+ * next NUM_MU_UNITS (multipliers) those in MU_OPCODES and the last
+ * NUM_DIV_UNITS (dividers) those in DIV_OPCODES. Every unit takes at
+ * most one instruction per cycle from the IQ. A pipelined unit holds
+ * up to its latency instructions in flight, the others are busy for
+ * the whole latency */
+#define FU_OPCODE(op) (1u << (op))
+#ifndef NUM_IU_UNITS
+#define NUM_IU_UNITS 1
+#endif
+#ifndef IU_LATENCY
+#define IU_LATENCY 1
+#endif
+#ifndef IU_PIPELINED
+#define IU_PIPELINED 1
+#endif
+#ifndef IU_OPCODES
+#define IU_OPCODES (FU_OPCODE(OPCODE_ADD) | FU_OPCODE(OPCODE_SUB) | FU_OPCODE(OPCODE_AND) | FU_OPCODE(OPCODE_OR) | \
+                    FU_OPCODE(OPCODE_XOR) | FU_OPCODE(OPCODE_CMP) | FU_OPCODE(OPCODE_ADDL) | FU_OPCODE(OPCODE_SUBL) | \
+                    FU_OPCODE(OPCODE_MOVC) | FU_OPCODE(OPCODE_NOP) | FU_OPCODE(OPCODE_HALT))
+#endif
+#ifndef NUM_MU_UNITS
+#define NUM_MU_UNITS 1
+#endif
+#ifndef MU_LATENCY
+#define MU_LATENCY 4
+#endif
+#ifndef MU_PIPELINED
+#define MU_PIPELINED 1
+#endif
+#ifndef MU_OPCODES
+#define MU_OPCODES FU_OPCODE(OPCODE_MUL)
+#endif
+
+/* Iterative dividers are never pipelined. DIV_LATENCY is the worst
+ * case, with DIV_EARLY_OUT a division retires DIV_BITS_PER_CYCLE
+ * quotient bits per cycle and stops once the quotient bits implied by
+ * the operand magnitudes are done */
+#ifndef NUM_DIV_UNITS
+#define NUM_DIV_UNITS 1
+#endif
+#ifndef DIV_LATENCY
+#define DIV_LATENCY 4
+#endif
+#ifndef DIV_EARLY_OUT
+#define DIV_EARLY_OUT 0
+#endif
+#ifndef DIV_BITS_PER_CYCLE
+#define DIV_BITS_PER_CYCLE ((32 + DIV_LATENCY - 1) / DIV_LATENCY)
+#endif
+#ifndef DIV_OPCODES
+#define DIV_OPCODES FU_OPCODE(OPCODE_DIV)
+#endif
+#define NUM_FUS (NUM_IU_UNITS + NUM_MU_UNITS + NUM_DIV_UNITS)
+#define FU_MAX_IN_FLIGHT (IU_LATENCY > MU_LATENCY ? IU_LATENCY : MU_LATENCY)
+
+/* Branch units resolving the control transfers, each takes at most
+ * one branch per cycle from the IQ. Branches resolving in the same
+ * cycle are handled oldest first, a redirect squashes the younger ones */
+#ifndef NUM_BU_UNITS
+#define NUM_BU_UNITS 1
+#endif
+
+/* Conditional branch direction predictor selection, override with
+ * BRANCH_PREDICTOR. Fetch predicts every conditional branch, a taken
+ * prediction needs the target from the BTB */
+#define PREDICTOR_BIMODAL 0
+#define PREDICTOR_GSHARE 1
+#define PREDICTOR_TOURNAMENT 2
+#define PREDICTOR_TAGE 3
+#ifndef BRANCH_PREDICTOR
+#define BRANCH_PREDICTOR PREDICTOR_TOURNAMENT
+#endif
+
+/* 2-bit counter tables of the bimodal, gshare and tournament chooser
+ * (power of two), gshare XORs BP_HISTORY_BITS of global history into
+ * the PC */
+#ifndef BP_TABLE_SIZE
+#define BP_TABLE_SIZE 1024
+#endif
+#ifndef BP_HISTORY_BITS
+#define BP_HISTORY_BITS 10
+#endif
+
+/* TAGE tagged tables (power of two entries), table i uses
+ * TAGE_MIN_HISTORY << i bits of global history, at most 64 */
+#ifndef TAGE_NUM_TABLES
+#define TAGE_NUM_TABLES 4
+#endif
+#ifndef TAGE_TABLE_SIZE
+#define TAGE_TABLE_SIZE 256
+#endif
+#ifndef TAGE_TAG_BITS
+#define TAGE_TAG_BITS 9
+#endif
+#ifndef TAGE_MIN_HISTORY
+#define TAGE_MIN_HISTORY 4
+#endif
+#define TAGE_USEFUL_RESET_PERIOD 262144
+
+/* Return address stack, fetch pushes the return address of a JALR
+ * and predicts a RET with the top entry. Set to 0 to predict RET from
+ * the BTB like any other jump */
+#ifndef RETURN_ADDRESS_STACK
+#define RETURN_ADDRESS_STACK 1
+#endif
+#ifndef RAS_SIZE
+#define RAS_SIZE 8
+#endif
+
+/* Tagged indirect target predictor for JUMP and JALR (power of two
+ * entries), indexed by the PC XOR INDIRECT_HISTORY_BITS of global
+ * history. A miss falls back to the BTB target */
+#ifndef INDIRECT_PREDICTOR
+#define INDIRECT_PREDICTOR 1
+#endif
+#ifndef INDIRECT_TABLE_SIZE
+#define INDIRECT_TABLE_SIZE 64
+#endif
+#ifndef INDIRECT_HISTORY_BITS
+#define INDIRECT_HISTORY_BITS 4
+#endif
+
+/* Set associative BTB of BTB_SETS (power of two) x BTB_WAYS entries,
+ * indexed by a hash of the PC with LRU replacement in each set */
+#ifndef BTB_SETS
+#define BTB_SETS 8
+#endif
+#ifndef BTB_WAYS
+#define BTB_WAYS 4
+#endif
+#define BTB_SIZE (BTB_SETS * BTB_WAYS)
+
+/* Decode computes the target of BZ/BNZ/BP/BNP (PC + literal). A branch
+ * predicted taken that missed in the BTB redirects fetch from decode
+ * and puts its target in the BTB instead of waiting for execute */
+#ifndef DECODE_REDIRECT
+#define DECODE_REDIRECT 1
+#endif
+
+/* The branch unit redirects fetch in the cycle a control transfer
+ * resolves. Prediction restarts BRANCH_REDIRECT_PENALTY cycles later,
+ * the extra refill cycles of a deeper front end */
+#ifndef BRANCH_REDIRECT_PENALTY
+#define BRANCH_REDIRECT_PENALTY 0
+#endif
+
+/* Data cache timing model (sizes in words, latencies in cycles) */
+#ifndef DCACHE_SETS
+#define DCACHE_SETS 16
+#endif
+#ifndef DCACHE_WAYS
+#define DCACHE_WAYS 2
+#endif
+#ifndef DCACHE_LINE_SIZE
+#define DCACHE_LINE_SIZE 4
+#endif
+#ifndef DCACHE_HIT_LATENCY
+#define DCACHE_HIT_LATENCY 2
+#endif
+#ifndef DCACHE_MISS_LATENCY
+#define DCACHE_MISS_LATENCY 20
+#endif
+
+/* Set to 1 to evaluate LRU data caches of 1 to SWEEP_MAX_SETS sets
+ * and 1 to SWEEP_MAX_WAYS ways on the demand reference stream of one
+ * run (stack distance simulation), lines are DCACHE_LINE_SIZE words */
+#ifndef CACHE_SWEEP
+#define CACHE_SWEEP 0
+#endif
+#define SWEEP_SET_CONFIGS 8
+#define SWEEP_MAX_SETS (1 << (SWEEP_SET_CONFIGS - 1))
+#define SWEEP_MAX_WAYS 16
+
+/* Set to 1 to write every committed LOAD/STORE to MEM_TRACE_FILE as
+ * MEM_TRACE_Record entries, apex_trace reads the file back. Loads are
+ * written when they retire and stores when they drain from the store
+ * buffer, so wrong path and runahead accesses are left out. Records
+ * are collected in a buffer of MEM_TRACE_BUFFER_SIZE and written in blocks */
+#ifndef MEM_TRACE
+#define MEM_TRACE 0
+#endif
+#ifndef MEM_TRACE_FILE
+#define MEM_TRACE_FILE "apex_mem.trace"
+#endif
+#define MEM_TRACE_BUFFER_SIZE 4096
+#define MEM_TRACE_STORE 0x80000000u
+
+/* Miss status holding registers of the non-blocking LSU */
+#ifndef NUM_MSHRS
+#define NUM_MSHRS 4
+#endif
+#ifndef MSHR_TARGETS
+#define MSHR_TARGETS 4
+#endif
+
+/* Load and store pipes of the LSU, each pipe takes one access per
+ * cycle from the LSQ and has its own writeback slot */
+#ifndef NUM_LOAD_PIPES
+#define NUM_LOAD_PIPES 2
+#endif
+#ifndef NUM_STORE_PIPES
+#define NUM_STORE_PIPES 1
+#endif
+#define NUM_LS_PIPES (NUM_LOAD_PIPES + NUM_STORE_PIPES)
+
+/* Address generation units, LOAD/STORE compute their address here
+ * instead of on the IU. With STORE_SPLIT_STA_STD a store address
+ * is generated without waiting for the store data */
+#ifndef NUM_AGU_PIPES
+#define NUM_AGU_PIPES 1
+#endif
+#ifndef STORE_SPLIT_STA_STD
+#define STORE_SPLIT_STA_STD 1
+#endif
+
+/* Word interleaved data cache banks, one access per bank per cycle */
+#ifndef DCACHE_BANKS
+#define DCACHE_BANKS 4
+#endif
+
+/* Post-commit store buffer, stores leave the LSQ into it and write
+ * the data cache in program order once they have retired */
+#ifndef STORE_BUFFER_SIZE
+#define STORE_BUFFER_SIZE 8
+#endif
+
+/* Cycles for a load to take its data from an older store in the LSQ */
+#ifndef STORE_FORWARD_LATENCY
+#define STORE_FORWARD_LATENCY 1
+#endif
+
+/* Set to 1 to let loads issue past older stores whose address is
+ * still unknown, a wrong guess is caught when the store issues */
+#ifndef LOAD_SPECULATION
+#define LOAD_SPECULATION 0
+#endif
+
+/* Store set memory dependence predictor, used with LOAD_SPECULATION.
+ * The SSIT is cleared every SSIT_CLEAR_INTERVAL cycles so that stale
+ * dependences do not hold loads back forever */
+#ifndef STORE_SET_PREDICTOR
+#define STORE_SET_PREDICTOR 1
+#endif
+#define SSIT_SIZE 64
+#define LFST_SIZE 16
+#define SSIT_CLEAR_INTERVAL 100000
+
+/* Set to 1 to keep executing past a load miss that blocks the ROB
+ * head, results depending on the miss are poisoned and the misses
+ * found on the way become prefetches. Misses that return within
+ * RUNAHEAD_MIN_CYCLES do not start an episode */
+#ifndef RUNAHEAD_EXECUTION
+#define RUNAHEAD_EXECUTION 0
+#endif
+#ifndef RUNAHEAD_MIN_CYCLES
+#define RUNAHEAD_MIN_CYCLES 8
+#endif
+
+/* Set to 1 for a PC indexed last value/stride load value predictor,
+ * dependents of a confidently predicted LOAD read the predicted value
+ * at dispatch and are squashed if writeback delivers a different one */
+#ifndef LOAD_VALUE_PREDICTION
+#define LOAD_VALUE_PREDICTION 0
+#endif
+#define LVP_TABLE_SIZE 32
+#define LVP_CONFIDENCE_MAX 7
+#ifndef LVP_CONFIDENCE_THRESHOLD
+#define LVP_CONFIDENCE_THRESHOLD 3
+#endif
+
+/* Data prefetcher selection, override with DATA_PREFETCHER */
+#define PREFETCHER_NONE 0
+#define PREFETCHER_STRIDE 1
+#define PREFETCHER_STREAM 2
+#ifndef DATA_PREFETCHER
+#define DATA_PREFETCHER PREFETCHER_STRIDE
+#endif
+
+/* Number of lines (stream) or strides (stride) fetched ahead */
+#ifndef PREFETCH_DEGREE
+#define PREFETCH_DEGREE 2
+#endif
+
+/* PC indexed reference prediction table of the stride prefetcher */
+#define STRIDE_TABLE_SIZE 16
+#define STRIDE_CONFIDENCE_MAX 3
+#define STRIDE_CONFIDENCE_THRESHOLD 2
 
 /* Numeric OPCODE identifiers for instructions */
 #define OPCODE_ADD 0x0
@@ -48,6 +404,10 @@
 #define OPCODE_JALR 0x16
 #define OPCODE_RET 0x17
 
+/* ROB exception code of a load that read memory before an older
+ * store to the same address, it is re-executed from the ROB head */
+#define EXCODE_MEMORY_ORDER_VIOLATION 0x1
+
 /* Set this flag to 1 to enable debug messages */
 #define ENABLE_DEBUG_MESSAGES 0
 
@@ -58,7 +418,7 @@
 #define DIABLE_SINGLE_STEP 0
 
 /* Number of pipeline stages */
-#define NUM_OF_PIPELINE_STAGES 12
+#define NUM_OF_PIPELINE_STAGES 10
 
 /* Base program cunter value */
 #define PC_START 4000
@@ -0,0 +1,291 @@
+/*
+ * apex_trace.c
+ * Reads the memory trace written by apex_sim built with MEM_TRACE=1 and
+ * reports reuse distance, working set size over time and per PC locality.
+ * The trace only holds committed accesses in commit order, loads at
+ * retirement and stores when they drain from the store buffer
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Reuse distances are bucketed by powers of two, the last bucket also
+ * holds everything farther away */
+#define REUSE_BUCKETS 12
+
+/* Locality of the references made by one instruction */
+typedef struct PC_Stats
+{
+    unsigned int pc;
+    unsigned int loads;
+    unsigned int stores;
+    unsigned int cold;
+    unsigned int reuses;
+    unsigned long long distance_sum;
+    unsigned int cache_hits;
+} PC_Stats;
+
+/*
+ * Function to return the reuse distance bucket of a distance
+ */
+static int
+get_reuse_bucket(int distance)
+{
+    int bucket = 0;
+
+    while (bucket < REUSE_BUCKETS - 1 && distance >= (1 << bucket))
+    {
+        bucket++;
+    }
+    return bucket;
+}
+
+/*
+ * Function to return the stats of a PC, adding an entry on first use
+ */
+static PC_Stats *
+get_pc_stats(PC_Stats **pcs, int *num_pcs, unsigned int pc)
+{
+    for (int i = 0; i < *num_pcs; i++)
+    {
+        if ((*pcs)[i].pc == pc)
+        {
+            return &(*pcs)[i];
+        }
+    }
+    *pcs = realloc(*pcs, (*num_pcs + 1) * sizeof(PC_Stats));
+    if (!*pcs)
+    {
+        fprintf(stderr, "APEX_Error: Out of memory\n");
+        exit(1);
+    }
+    memset(&(*pcs)[*num_pcs], 0, sizeof(PC_Stats));
+    (*pcs)[*num_pcs].pc = pc;
+    return &(*pcs)[(*num_pcs)++];
+}
+
+/*
+ * Function to order PCs by number of references, most frequent first
+ */
+static int
+compare_pc_stats(const void *a, const void *b)
+{
+    const PC_Stats *x = a;
+    const PC_Stats *y = b;
+
+    return (int)(y->loads + y->stores) - (int)(x->loads + x->stores);
+}
+
+/*
+ * Function to look a line up in the LRU stack and move it to the top.
+ * Returns the number of distinct lines touched since its last use, or
+ * -1 on its first use
+ */
+static int
+lru_stack_access(int *stack, int *depth, int line)
+{
+    int distance = -1;
+
+    for (int i = 0; i < *depth; i++)
+    {
+        if (stack[i] == line)
+        {
+            distance = i;
+            break;
+        }
+    }
+    if (distance < 0)
+    {
+        memmove(&stack[1], &stack[0], *depth * sizeof(int));
+        (*depth)++;
+    }
+    else
+    {
+        memmove(&stack[1], &stack[0], distance * sizeof(int));
+    }
+    stack[0] = line;
+    return distance;
+}
+
+int
+main(int argc, char const *argv[])
+{
+    FILE *fp;
+    MEM_TRACE_Record record;
+    int line_size = DCACHE_LINE_SIZE;
+    unsigned int window = 100;
+    int cache_lines = DCACHE_SETS * DCACHE_WAYS;
+    int num_lines = DATA_MEMORY_SIZE;
+    int *stack;
+    int depth = 0;
+    unsigned char *in_window;
+    int window_lines = 0;
+    unsigned int window_start = 0;
+    unsigned int window_refs = 0;
+    unsigned int histogram[REUSE_BUCKETS] = {0};
+    unsigned int records = 0, loads = 0, stores = 0, cold = 0;
+    unsigned int cumulative = 0;
+    PC_Stats *pcs = NULL;
+    int num_pcs = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s <trace_file> [line_size_words] [window_cycles]\n", argv[0]);
+        exit(1);
+    }
+    if (argc > 2)
+    {
+        line_size = atoi(argv[2]);
+    }
+    if (argc > 3)
+    {
+        window = atoi(argv[3]);
+    }
+    if (line_size <= 0 || window == 0)
+    {
+        fprintf(stderr, "APEX_Error: Line size and window must be positive\n");
+        exit(1);
+    }
+
+    fp = fopen(argv[1], "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open trace file %s\n", argv[1]);
+        exit(1);
+    }
+
+    num_lines = (DATA_MEMORY_SIZE + line_size - 1) / line_size;
+    stack = calloc(num_lines, sizeof(int));
+    in_window = calloc(num_lines, sizeof(unsigned char));
+    if (!stack || !in_window)
+    {
+        fprintf(stderr, "APEX_Error: Out of memory\n");
+        exit(1);
+    }
+
+    printf("Trace %s, line = %d words, window = %u cycles\n", argv[1], line_size, window);
+    printf("\n==================== WORKING SET =====================\n\n");
+    printf(" %10s %10s %10s %10s\n", "cycle", "references", "lines", "words");
+
+    while (fread(&record, sizeof(MEM_TRACE_Record), 1, fp) == 1)
+    {
+        int is_store = (record.address & MEM_TRACE_STORE) != 0;
+        int address = record.address & ~MEM_TRACE_STORE;
+        int line;
+        int distance;
+        PC_Stats *pc_stats;
+
+        if (address >= DATA_MEMORY_SIZE)
+        {
+            fprintf(stderr, "APEX_Error: Bad address %d in record %u\n", address, records);
+            continue;
+        }
+        line = address / line_size;
+
+        /* Close the working set windows this record has moved past */
+        while (record.cycle >= window_start + window)
+        {
+            if (window_refs)
+            {
+                printf(" %10u %10u %10d %10d\n", window_start, window_refs, window_lines, window_lines * line_size);
+            }
+            memset(in_window, 0, num_lines);
+            window_lines = 0;
+            window_refs = 0;
+            window_start += window;
+        }
+        window_refs++;
+        if (!in_window[line])
+        {
+            in_window[line] = 1;
+            window_lines++;
+        }
+
+        records++;
+        pc_stats = get_pc_stats(&pcs, &num_pcs, record.pc);
+        if (is_store)
+        {
+            stores++;
+            pc_stats->stores++;
+        }
+        else
+        {
+            loads++;
+            pc_stats->loads++;
+        }
+
+        distance = lru_stack_access(stack, &depth, line);
+        if (distance < 0)
+        {
+            cold++;
+            pc_stats->cold++;
+        }
+        else
+        {
+            histogram[get_reuse_bucket(distance)]++;
+            pc_stats->reuses++;
+            pc_stats->distance_sum += distance;
+            if (distance < cache_lines)
+            {
+                pc_stats->cache_hits++;
+            }
+        }
+    }
+    if (window_refs)
+    {
+        printf(" %10u %10u %10d %10d\n", window_start, window_refs, window_lines, window_lines * line_size);
+    }
+    fclose(fp);
+
+    printf("\n==================== REUSE DISTANCE =====================\n\n");
+    printf("References = %u loads = %u stores = %u footprint = %d lines (%d words)\n",
+           records, loads, stores, depth, depth * line_size);
+    printf("A fully associative LRU cache of N lines hits every reuse at distance < N\n\n");
+    printf(" %12s %10s %8s %12s\n", "distance", "reuses", "share", "hit rate");
+    for (int i = 0; i < REUSE_BUCKETS; i++)
+    {
+        char range[32];
+
+        if (i < 2)
+        {
+            sprintf(range, "%d", i);
+        }
+        else if (i == REUSE_BUCKETS - 1)
+        {
+            sprintf(range, ">= %d", 1 << (i - 1));
+        }
+        else
+        {
+            sprintf(range, "%d-%d", 1 << (i - 1), (1 << i) - 1);
+        }
+        cumulative += histogram[i];
+        printf(" %12s %10u %7.2f%% %11.2f%%\n", range, histogram[i],
+               records ? 100.0 * histogram[i] / records : 0.0,
+               records ? 100.0 * cumulative / records : 0.0);
+    }
+    printf(" %12s %10u %7.2f%%\n", "cold", cold, records ? 100.0 * cold / records : 0.0);
+
+    printf("\n==================== PER PC LOCALITY =====================\n\n");
+    printf("Hit rate is for a fully associative LRU cache of DCACHE_SETS x DCACHE_WAYS = %d lines\n\n", cache_lines);
+    printf(" %6s %8s %8s %8s %8s %14s %10s\n", "pc", "loads", "stores", "cold", "reuses", "avg distance", "hit rate");
+    qsort(pcs, num_pcs, sizeof(PC_Stats), compare_pc_stats);
+    for (int i = 0; i < num_pcs; i++)
+    {
+        unsigned int refs = pcs[i].loads + pcs[i].stores;
+
+        printf(" %6u %8u %8u %8u %8u %14.2f %9.2f%%\n", pcs[i].pc, pcs[i].loads, pcs[i].stores, pcs[i].cold,
+               pcs[i].reuses, pcs[i].reuses ? (double)pcs[i].distance_sum / pcs[i].reuses : 0.0,
+               refs ? 100.0 * pcs[i].cache_hits / refs : 0.0);
+    }
+
+    free(pcs);
+    free(stack);
+    free(in_window);
+    return 0;
+}
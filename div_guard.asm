@@ -0,0 +1,17 @@
+MOVC R2,#100
+MOVC R3,#0
+MOVC R4,#300
+MOVC R8,#5
+STORE R8,R4,#0
+ADDL R4,R4,#1
+SUBL R8,R8,#1
+BNZ #-12
+MOVC R4,#300
+LOAD R1,R4,#0
+ADDL R6,R1,#0
+BZ #20
+DIV R5,R2,R1
+ADD R3,R3,R5
+ADDL R4,R4,#1
+BNZ #-24
+HALT
\ No newline at end of file
@@ -0,0 +1,29 @@
+MOVC R11,#4016
+JUMP R11,#0
+ADDL R3,R3,#1
+RET R7
+MOVC R10,#1
+MOVC R9,#0
+MOVC R8,#8
+MOVC R4,#100
+STORE R9,R4,#0
+SUB R9,R10,R9
+ADDL R4,R4,#1
+SUBL R8,R8,#1
+BNZ #-16
+MOVC R11,#4008
+MOVC R4,#100
+MOVC R8,#8
+MOVC R3,#0
+LOAD R1,R4,#0
+ADDL R6,R1,#0
+BZ #8
+ADDL R3,R3,#10
+SUBL R5,R8,#4
+BNZ #8
+ADDL R3,R3,#100
+JALR R7,R11,#0
+ADDL R4,R4,#1
+SUBL R8,R8,#1
+BNZ #-40
+HALT
\ No newline at end of file
@@ -0,0 +1,10 @@
+MOVC R7,#100
+MOVC R2,#-100003
+MOVC R5,#7
+LOAD R1,R7,#0
+ADDL R3,R1,#0
+BZ #12
+LOAD R4,R2,#0
+STORE R5,R2,#4
+MOVC R6,#5
+HALT
\ No newline at end of file